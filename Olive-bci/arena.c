@@ -0,0 +1,42 @@
+#include <string.h>
+
+#include "arena.h"
+#include "memory.h"
+
+void initArena(Arena* arena) {
+	arena->chunks = NULL;
+}
+
+static ArenaChunk* newChunk(size_t capacity) {
+	ArenaChunk* chunk = (ArenaChunk*)reallocate(NULL, 0, sizeof(ArenaChunk) + capacity);
+	chunk->next = NULL;
+	chunk->count = 0;
+	chunk->capacity = capacity;
+	return chunk;
+}
+
+/* Copy 'length' characters into the arena, followed by a '\0'. The copy never moves. */
+const char* arenaAppend(Arena* arena, const char* text, size_t length) {
+	ArenaChunk* chunk = arena->chunks;
+	if (chunk == NULL || chunk->capacity - chunk->count < length + 1) {
+		chunk = newChunk(length + 1 > ARENA_CHUNK_SIZE ? length + 1 : ARENA_CHUNK_SIZE);
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+	}
+	
+	char* copy = chunk->text + chunk->count;
+	memcpy(copy, text, length);
+	copy[length] = '\0';
+	chunk->count += length + 1;
+	return copy;
+}
+
+void freeArena(Arena* arena) {
+	ArenaChunk* chunk = arena->chunks;
+	while (chunk != NULL) {
+		ArenaChunk* next = chunk->next;
+		reallocate(chunk, sizeof(ArenaChunk) + chunk->capacity, 0);
+		chunk = next;
+	}
+	initArena(arena);
+}
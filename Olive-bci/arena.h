@@ -0,0 +1,25 @@
+#ifndef olive_arena_h
+#define olive_arena_h
+
+#include "common.h"
+
+// default size of an arena chunk. Longer pieces get a chunk of their own.
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+/* Append-only storage for REPL source lines. Chunks are never reallocated, so strings borrowing source text (ownString=false) stay valid for the whole session. */
+typedef struct ArenaChunk {
+	struct ArenaChunk* next;
+	size_t count;
+	size_t capacity;
+	char text[];
+} ArenaChunk;
+
+typedef struct {
+	ArenaChunk* chunks; // the chunk being filled, older chunks follow
+} Arena;
+
+void initArena(Arena* arena);
+void freeArena(Arena* arena);
+const char* arenaAppend(Arena* arena, const char* text, size_t length);
+
+#endif
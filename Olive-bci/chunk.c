@@ -5,14 +5,6 @@
 #include "memory.h"
 #include "vm.h"
 
-/*	Clear debug line info. If the debug flags are uncommented in 'common.h' this function helps to clear any existing	 
-line info in the case of a parsing error. */
-void clearLineInfo() {
-	currentLine = 0;
-	operationsPerLine = 0;
-	indx = 0;
-}
-
 /* Initialize a chunk to hold bytecode. */
 void initChunk(Chunk* chunk, ValueArray* constants) {
 	chunk->count = 0;
@@ -20,6 +12,7 @@ void initChunk(Chunk* chunk, ValueArray* constants) {
 	chunk->code = NULL;
 	chunk->lineArr = NULL;
 	chunk->codeArr = NULL;
+	chunk->lineCount = 0;
 	//initValueArray(&chunk->constants);
 	chunk->constants = constants;
 }
@@ -43,27 +36,28 @@ void freeChunkButNotValueArray(Chunk* chunk) {
 	chunk->code = NULL;
 	chunk->lineArr = NULL;
 	chunk->codeArr = NULL;
+	chunk->lineCount = 0;
 }
 
 /* Write a byte to a chunk. */
 void writeChunk(Chunk* chunk, uint8_t byte, int line) {
 	if(chunk->capacity < chunk->count + 1) {
+		// capacity is only bumped once all three arrays have grown, a failed grow leaves the chunk consistent.
 		int oldCapacity = chunk->capacity;
-		chunk->capacity = GROW_CAPACITY(oldCapacity);
-		chunk->code = GROW_ARRAY(uint8_t, chunk->code, oldCapacity, chunk->capacity);
-		chunk->lineArr = GROW_ARRAY(int, chunk->lineArr, oldCapacity, chunk->capacity);
-		chunk->codeArr = GROW_ARRAY(int, chunk->codeArr, oldCapacity, chunk->capacity);
+		int capacity = GROW_CAPACITY(oldCapacity);
+		chunk->code = GROW_ARRAY(uint8_t, chunk->code, oldCapacity, capacity);
+		chunk->lineArr = GROW_ARRAY(int, chunk->lineArr, oldCapacity, capacity);
+		chunk->codeArr = GROW_ARRAY(int, chunk->codeArr, oldCapacity, capacity);
+		chunk->capacity = capacity;
 	}
 	
-	if (line != currentLine) {
-		currentLine = line;
-		operationsPerLine = 1;
-		chunk->lineArr[indx] = line;
-		temp = indx;
-		chunk->codeArr[temp] = operationsPerLine;
-		indx++; 
+	// each chunk keeps its own runs, so compiling a nested function doesn't disturb the enclosing one's.
+	if (chunk->lineCount == 0 || chunk->lineArr[chunk->lineCount - 1] != line) {
+		chunk->lineArr[chunk->lineCount] = line;
+		chunk->codeArr[chunk->lineCount] = 1;
+		chunk->lineCount++;
 	} else {
-		chunk->codeArr[temp] = ++operationsPerLine;
+		chunk->codeArr[chunk->lineCount - 1]++;
 	}
 	
 	chunk->code[chunk->count] = byte;
@@ -96,9 +90,11 @@ void writeConstant(Chunk* chunk, Value value, int line) {
 
 /* Returns the current line of execution for debug and error handling. */
 int getLine(Chunk* chunk, int instructionIndex) {
+	if (chunk->lineCount == 0) return 0;
+	
 	int sum = 0;
 	int i;
-	for (i = 0; sum <= instructionIndex; i++ ) {
+	for (i = 0; sum <= instructionIndex && i < chunk->lineCount; i++ ) {
 		sum += chunk->codeArr[i];
 	}
 	
@@ -4,12 +4,6 @@
 #include "common.h"
 #include "value.h"
 
-/* Line info cleared by clearLineInfo() function at parsing error. */
-static int currentLine = 0;
-static int operationsPerLine = 0;
-static int indx = 0;
-static int temp;
-
 /* Bytecode instructions-set. */
 typedef enum {
 	OP_CONSTANT_LONG,
@@ -26,6 +20,8 @@ typedef enum {
 	OP_SET_UPVALUE,
 	OP_GET_PROPERTY,
 	OP_SET_PROPERTY,
+	OP_INDEX_GET,
+	OP_INDEX_SET,
 	OP_GET_BASE,
 	OP_DELATTR,
 	OP_DEFINE_GLOBAL,
@@ -39,10 +35,14 @@ typedef enum {
 	OP_LESS_EQUAL,
 	OP_TERNARY,
 	OP_ADD,
+	OP_BUILD_STRING,
+	OP_BUILD_LIST,
+	OP_BUILD_MAP,
 	OP_SUBTRACT,
 	OP_MULTIPLY,
 	OP_DIVIDE,
 	OP_MOD,
+	OP_INT_DIVIDE,
 	OP_PERCENT,
 	OP_NOT,	
 	OP_NEGATE,
@@ -50,7 +50,11 @@ typedef enum {
 	OP_JUMP,
 	OP_JUMP_IF_FALSE,
 	OP_LOOP,
+	OP_ITER_NEXT,
+	OP_FOR_PREP,
+	OP_FOR_STEP,
 	OP_CALL,
+	OP_MATH,
 	OP_CLOSURE,
 	OP_CLOSE_UPVALUE,
 	OP_BREAK,
@@ -63,6 +67,19 @@ typedef enum {
 	OP_INVOKE,
 	OP_BASE_INVOKE,
 	OP_METHOD,
+	OP_END_CLASS,
+	// the instructions above with a constant operand, taking a 3 byte index for constants past the first 256.
+	OP_GET_GLOBAL_LONG,
+	OP_DEFINE_GLOBAL_LONG,
+	OP_SET_GLOBAL_LONG,
+	OP_GET_PROPERTY_LONG,
+	OP_SET_PROPERTY_LONG,
+	OP_GET_BASE_LONG,
+	OP_INVOKE_LONG,
+	OP_BASE_INVOKE_LONG,
+	OP_CLOSURE_LONG,
+	OP_CLASS_LONG,
+	OP_METHOD_LONG,
 } OpCode;
 
 /* A Chunk type to hold the bytecode instructions. A dynamic array with the ValueArray included in it's definition. */
@@ -71,7 +88,8 @@ typedef struct {
 	int capacity;
 	uint8_t* code;
 	int* lineArr;
-	int* codeArr;
+	int* codeArr; // run-length line info: codeArr[i] bytes in a row come from line lineArr[i]
+	int lineCount; // runs in lineArr and codeArr
 	ValueArray* constants;
 } Chunk;
 
@@ -82,6 +100,5 @@ void writeChunk(Chunk* chunk, uint8_t bytes, int line);
 int addConstant(Chunk* chunk, Value value, bool constness);
 void writeConstant(Chunk* chunk, Value value, int line);
 int getLine(Chunk* chunk, int instructionIndex);
-void clearLineInfo();
 
 #endif
@@ -12,6 +12,9 @@
 //#define DEBUG_STRESS_GC
 //#define DEBUG_LOG_GC
 
+#define GC_COMPACT // evacuate live objects into fresh memory once the heap gets fragmented
+//#define DEBUG_STRESS_COMPACT
+
 #define SCOPE_COUNT 1000 // Increase to 32 bits if too little over time.
 
 #endif
@@ -1,5 +1,6 @@
 /* TO CONTRIBUTORS: Note that the function calls are recursive in nature so a function description preceeding a function would mostly encompass it's instructions and that of it's sub-calls. */
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,6 +11,7 @@
 #include "scanner.h"
 #include "chunk.h"
 #include "control.h"
+#include "native.h"
 
 #ifdef DEBUG_PRINT_CODE
 #include "debug.h"
@@ -44,7 +46,6 @@ typedef enum {
 	PREC_AND,
 	PREC_EQUALITY,
 	PREC_COMPARISON,
-	PREC_INTERPOLATION,
 	PREC_TERM,
 	PREC_FACTOR,
 	PREC_UNARY,
@@ -131,7 +132,7 @@ typedef struct ClassCompiler {
 	bool hasBaseClass;
 } ClassCompiler;
 
-/* ClassMethodsIndex (CMI) struct. Dynamic array*/
+/* ClassMethodsIndex (CMI) struct. Dynamic array of the name constants of the methods of the class being compiled, to catch a method declared twice. */
 typedef struct {
 	int count;
 	int capacity;
@@ -344,21 +345,58 @@ static void initCompiler(Compiler* compiler, FunctionType type, ValueArray* cons
 		local->name.start = "";
 		local->name.length = 0;
 	}
-	clearLineInfo();
 }
 
-/* Variation of emitByte(). Emit a byte and the index of a 'Value' in the value array to the curren compiling chunk. */
+/* the variant of an instruction with a 3 byte constant index. */
+static uint8_t longOpCode(uint8_t byte) {
+	switch (byte) {
+		case OP_GET_GLOBAL: return OP_GET_GLOBAL_LONG;
+		case OP_DEFINE_GLOBAL: return OP_DEFINE_GLOBAL_LONG;
+		case OP_SET_GLOBAL: return OP_SET_GLOBAL_LONG;
+		case OP_GET_PROPERTY: return OP_GET_PROPERTY_LONG;
+		case OP_SET_PROPERTY: return OP_SET_PROPERTY_LONG;
+		case OP_GET_BASE: return OP_GET_BASE_LONG;
+		case OP_INVOKE: return OP_INVOKE_LONG;
+		case OP_BASE_INVOKE: return OP_BASE_INVOKE_LONG;
+		case OP_CLOSURE: return OP_CLOSURE_LONG;
+		case OP_CLASS: return OP_CLASS_LONG;
+		case OP_METHOD: return OP_METHOD_LONG;
+		default:
+			error("Too large an operand.");
+			return byte;
+	}
+}
+
+/* Variation of emitByte(). Emit a byte and the index of a 'Value' in the value array to the curren compiling chunk. Indices past 255 take the instruction's '_LONG' variant and 3 bytes. */
 static void emitOpAndConstant(uint8_t byte, int constant) {
-	emitByte(byte);
 	if (constant < 256) {
+		emitByte(byte);
 		writeChunk(currentChunk(), (uint8_t)constant, parser.previous.line);
 	} else {
+		emitByte(longOpCode(byte));
 		writeChunk(currentChunk(), (uint8_t)(constant & 0xff), parser.previous.line);
 		writeChunk(currentChunk(), (uint8_t)((constant >> 8) & 0xff), parser.previous.line);
 		writeChunk(currentChunk(), (uint8_t)((constant >> 16) & 0xff), parser.previous.line);
 	}
 }
 
+/* the selector of a method name, see methodSelector(). */
+static int selector(ObjString* name) {
+	int id = methodSelector(name);
+	if (id < 0) {
+		error("Too many distinct method names.");
+		return 0;
+	}
+	return id;
+}
+
+/* emit the 2 byte selector operand of an invoke instruction. */
+static void emitSelector(ObjString* name) {
+	int id = selector(name);
+	emitByte((id >> 8) & 0xff);
+	emitByte(id & 0xff);
+}
+
 /* emit a return instruction to the current compiling chunk. */
 static void emitReturn() {
 	if (current->type == TYPE_INITIALIZER) {
@@ -382,7 +420,6 @@ static ObjFunction* endCompiler() {
 #endif
 	
 	current = current->enclosing;
-	clearLineInfo();
 	return function;
 }
 
@@ -423,7 +460,7 @@ static void parsePrecedence(Precedence precedence);
 /* Add the current token to the 'globalConstantIndex' hash map and return an error if it's an attempt at double initialization. Key is the token as an ObjString, Value is the token's index in the value array.
    Read above for more on the implementation.
 */
-static int identifierConstantDeclaration(Token* name, bool isConst, bool isMethod) {
+static int identifierConstantDeclaration(Token* name, bool isConst) {
 	ObjString* objString = allocateString(false, name->start, name->length);
 
 	if (tableSetGlobal(&vm.globalConstantIndex, &OBJ_KEY(objString), NUMBER_VAL(currentChunk()->constants->count))) {
@@ -438,24 +475,50 @@ static int identifierConstantDeclaration(Token* name, bool isConst, bool isMetho
 		&&
 		!REPL
 		&&
-		currentClass == NULL
-		&&
-		!isMethod) {
+		currentClass == NULL) {
 			error("Attempt to re-declare variable type qualifier.");
 		}
 		return (int)AS_NUMBER(constantIndex);
 	}
 }
 
+/* The constant of a native's name, added the first time the script uses it, or -1 if there's no native of that name. Natives aren't in 'globalConstantIndex', so a global declared with the same name replaces them. */
+static int nativeConstant(ObjString* name) {
+	Value constantIndex;
+	if (tableGet(&vm.nativeConstantIndex, &OBJ_KEY(name), &constantIndex)) {
+		return (int)AS_NUMBER(constantIndex);
+	}
+	
+	for (int i = 0; i < vm.nativeIdentifierCount; i++) {
+		const char* native = vm.nativeIdentifiers[i];
+		if ((int)strlen(native) == name->length && memcmp(native, name->chars, name->length) == 0) {
+			int index = addConstant(currentChunk(), OBJ_VAL(name), false);
+			tableSet(&vm.nativeConstantIndex, &OBJ_KEY(name), NUMBER_VAL(index));
+			return index;
+		}
+	}
+	return -1;
+}
+
 /* Return the Value ('constantIndex') of the Key ('name' as an ObjString). */
 static int identifierConstantSetGet(Token* name) {
 	ObjString* objString = allocateString(false, name->start, name->length);
 	Value constantIndex;
-	if (!tableGet(&vm.globalConstantIndex, &OBJ_KEY(objString), &constantIndex)) {
-		error("Attempt to access undeclared variable.");
+	if (tableGet(&vm.globalConstantIndex, &OBJ_KEY(objString), &constantIndex)) {
+		return (int)AS_NUMBER(constantIndex);
 	}
 	
-	return (int)AS_NUMBER(constantIndex);
+	int index = nativeConstant(objString);
+	if (index == -1) {
+		error("Attempt to access undeclared variable.");
+		return 0;
+	}
+	return index;
+}
+
+/* a property or method name as a constant. These aren't globals, so they don't go through 'globalConstantIndex'. */
+static int nameConstant(Token* name) {
+	return addConstant(currentChunk(), OBJ_VAL(allocateString(false, name->start, name->length)), false);
 }
 
 /* check if two identifier tokens are equal. */
@@ -564,7 +627,7 @@ static int parseVariable(const char* errorMessage, bool isConst) {
 	declareVariable(isConst);
 	if (current->scopeDepth > 0) return 0;
 	
-	return identifierConstantDeclaration(&parser.previous, isConst, false);
+	return identifierConstantDeclaration(&parser.previous, isConst);
 }
 
 /* mark a variable as initialized. */
@@ -633,18 +696,18 @@ static void binary(bool canAssign) {
 	parsePrecedence((Precedence)(rule->precedence + 1));
 	
 	switch(operatorType) {
-		case TOKEN_BANG_EQUAL: emitByte(OP_NOT_EQUAL);
+		case TOKEN_BANG_EQUAL: emitByte(OP_NOT_EQUAL); break;
 		case TOKEN_EQUAL_EQUAL: emitByte(OP_EQUAL); break;
 		case TOKEN_GREATER: emitByte(OP_GREATER); break;
-		case TOKEN_GREATER_EQUAL: emitByte(OP_GREATER_EQUAL);
+		case TOKEN_GREATER_EQUAL: emitByte(OP_GREATER_EQUAL); break;
 		case TOKEN_LESS: emitByte(OP_LESS); break;
 		case TOKEN_LESS_EQUAL: emitByte(OP_LESS_EQUAL); break;
 		case TOKEN_PLUS: emitByte(OP_ADD); break;
-		case TOKEN_CONCAT: emitByte(OP_ADD); break;
 		case TOKEN_MINUS: emitByte(OP_SUBTRACT); break;
 		case TOKEN_STAR: emitByte(OP_MULTIPLY); break;
 		case TOKEN_SLASH: emitByte(OP_DIVIDE); break;
 		case TOKEN_MOD: emitByte(OP_MOD); break;
+		case TOKEN_DIV: emitByte(OP_INT_DIVIDE); break;
 		case TOKEN_PERCENT: emitByte(OP_PERCENT); break;
 		default:
 			return;
@@ -671,7 +734,7 @@ static void literal(bool canAssign) {
 /* emit instruction for accessing class methods or fields. */
 static void dot(bool canAssign) {
 	consume(TOKEN_IDENTIFIER, "Expect property name after '.'");
-	int name = addConstant(currentChunk(), OBJ_VAL(allocateString(false, parser.previous.start, parser.previous.length)), false);
+	int name = nameConstant(&parser.previous);
 	
 	if (canAssign && match(TOKEN_EQUAL)) {
 		expression();
@@ -680,11 +743,68 @@ static void dot(bool canAssign) {
 		uint8_t argCount = argumentList();
 		emitOpAndConstant(OP_INVOKE, name);
 		emitByte(argCount);
+		emitSelector(AS_STRING(currentChunk()->constants->values[name]));
 	} else {
 		emitOpAndConstant(OP_GET_PROPERTY, name);
 	}
 }
 
+/* emit instructions for a list literal '[a, b, c]'. */
+static void list(bool canAssign) {
+	int count = 0;
+	if (!check(TOKEN_RIGHT_BRACKET)) {
+		do {
+			// allow a trailing comma.
+			if (check(TOKEN_RIGHT_BRACKET)) break;
+			
+			expression();
+			if (count == 255) {
+				error("Can't have more than 255 elements in a list literal.");
+			}
+			count++;
+		} while (match(TOKEN_COMMA) && parser.current.type != TOKEN_EOF);
+	}
+	
+	consume(TOKEN_RIGHT_BRACKET, "Expect ']' after list elements.");
+	emitByte(OP_BUILD_LIST);
+	emitByte((uint8_t)count);
+}
+
+/* emit instructions for a map literal '{key: value, ...}'. */
+static void map(bool canAssign) {
+	int count = 0;
+	if (!check(TOKEN_RIGHT_BRACE)) {
+		do {
+			if (check(TOKEN_RIGHT_BRACE)) break;
+			
+			expression();
+			consume(TOKEN_COLON, "Expect ':' after map key.");
+			expression();
+			if (count == 255) {
+				error("Can't have more than 255 entries in a map literal.");
+			}
+			count++;
+		} while (match(TOKEN_COMMA) && parser.current.type != TOKEN_EOF);
+	}
+	
+	consume(TOKEN_RIGHT_BRACE, "Expect '}' after map entries.");
+	emitByte(OP_BUILD_MAP);
+	emitByte((uint8_t)count);
+}
+
+/* emit instructions for reading or assigning an element 'list[index]' or 'map[key]'. */
+static void subscript(bool canAssign) {
+	expression();
+	consume(TOKEN_RIGHT_BRACKET, "Expect ']' after index.");
+	
+	if (canAssign && match(TOKEN_EQUAL)) {
+		expression();
+		emitByte(OP_INDEX_SET);
+	} else {
+		emitByte(OP_INDEX_GET);
+	}
+}
+
 /* parse and emit instructions for grouped expressions '()'*/
 static void grouping(bool canAssign) {
 	expression();
@@ -693,6 +813,16 @@ static void grouping(bool canAssign) {
 
 /* emit instructions for numbers */
 static void number(bool canAssign) {
+	// a literal without a decimal point is an integer, unless it's too big for 64 bits.
+	if (memchr(parser.previous.start, '.', parser.previous.length) == NULL) {
+		errno = 0;
+		long long value = strtoll(parser.previous.start, NULL, 10);
+		if (errno != ERANGE) {
+			emitConstant(INT_VAL(value));
+			return;
+		}
+	}
+	
 	double value = strtod(parser.previous.start, NULL);
 	emitConstant(NUMBER_VAL(value));
 }
@@ -711,11 +841,7 @@ static void or_(bool canAssign) {
 
 /* emit instruction for strings. */
 static void string(bool canAssign) {
-	if (*(parser.previous.start) == '"') {
-		emitConstant(OBJ_VAL(allocateString(false, parser.previous.start + 1, parser.previous.length - 2)));
-	} else if (*(parser.previous.start) == ' ') {
-		emitConstant(OBJ_VAL(allocateString(false, parser.previous.start, parser.previous.length - 1)));
-	}
+	emitConstant(OBJ_VAL(allocateString(false, parser.previous.start + 1, parser.previous.length - 2)));
 }
 
 static void newline(bool canAssign) {
@@ -747,24 +873,70 @@ static void namedVariable(Token name, bool canAssign) {
 			error("Attempt to re-assign variable declared with type qualifier 'const'.");
 		} else if (current->locals[arg].isConst == true && !global) {
 			error("Attempt to re-assign variable declared with type qualifier 'const'.");
-		} else emitOpAndConstant(setOp, (uint8_t)arg);
+		} else emitOpAndConstant(setOp, arg);
 	} else {
-		emitOpAndConstant(getOp, (uint8_t)arg);
+		emitOpAndConstant(getOp, arg);
 	}
 }
 
-/* emit instructions to get already defined identifiers. */
+/* whether 'name' refers to the native of that name rather than a local, an upvalue or a global declared before. */
+static bool unshadowed(Token* name) {
+	if (resolveLocal(current, name) != -1 || resolveUpvalue(current, name) != -1) return false;
+	
+	// probed by the token's characters, so no string is made just to be looked up.
+	return tableFindString(&vm.globalConstantIndex, name->start, name->length, hashString(name->start, name->length)) == NULL;
+}
+
+/* emit instructions to get already defined identifiers. A math native called by name becomes OP_MATH, which takes the arguments straight off the stack. */
 static void variable(bool canAssign) {
-	namedVariable(parser.previous, canAssign);
+	Token name = parser.previous;
+	int function;
+	if (check(TOKEN_LEFT_PAREN) && (function = mathFunction(name.start, name.length)) != -1 && unshadowed(&name)) {
+		advance();
+		uint8_t argCount = argumentList();
+		emitByte(OP_MATH);
+		emitByte((uint8_t)function);
+		emitByte(argCount);
+		return;
+	}
+	
+	namedVariable(name, canAssign);
+}
+
+/* emit a literal piece of an interpolated string, empty pieces are left out. Returns the number of values pushed. */
+static int interpolationPiece(const char* start, int length) {
+	if (length == 0) return 0;
+	emitConstant(OBJ_VAL(allocateString(false, start, length)));
+	return 1;
 }
 
-/* emit instructions to handle interpolated strings. */
+/* emit instructions to handle interpolated strings. The literal pieces and the interpolated expressions are pushed in order and joined by a single OP_BUILD_STRING. */
 static void interpolation(bool canAssign) {
-	if (*(parser.previous.start) == '"') {
-		emitConstant(OBJ_VAL(allocateString(false, parser.previous.start + 1, parser.previous.length - 1)));
-	} else if (*(parser.previous.start) == ' ') {
-		emitConstant(OBJ_VAL(allocateString(false, parser.previous.start, parser.previous.length)));
+	// the first piece still holds the opening quote.
+	int pieceCount = interpolationPiece(parser.previous.start + 1, parser.previous.length - 1);
+	
+	for (;;) {
+		consume(TOKEN_CONCAT, "Expect '{' after '$' in interpolated string.");
+		expression();
+		pieceCount++;
+		consume(TOKEN_CONCAT, "Expect '}' after interpolated expression.");
+		
+		if (match(TOKEN_INTERPOLATION)) {
+			pieceCount += interpolationPiece(parser.previous.start, parser.previous.length);
+			continue;
+		}
+		
+		// the last piece ends with the closing quote.
+		consume(TOKEN_STRING, "Unterminated interpolated string.");
+		pieceCount += interpolationPiece(parser.previous.start, parser.previous.length - 1);
+		break;
+	}
+	
+	if (pieceCount > UINT8_MAX) {
+		error("Too many pieces in interpolated string.");
+		return;
 	}
+	emitOpAndConstant(OP_BUILD_STRING, pieceCount);
 }
 
 /* generate a synthetic token for 'this'. */
@@ -785,7 +957,7 @@ static void base_(bool canAssign) {
 	
 	consume(TOKEN_DOT, "Expect '.' after 'base' token.");
 	consume(TOKEN_IDENTIFIER, "Expect 'base class' method name.");
-	uint8_t name = identifierConstantDeclaration(&parser.previous, true, false);
+	int name = nameConstant(&parser.previous);
 	
 	namedVariable(syntheticToken("this"), false);
 	if (match(TOKEN_LEFT_PAREN)) {
@@ -793,6 +965,7 @@ static void base_(bool canAssign) {
 		namedVariable(syntheticToken("base"), false);
 		emitOpAndConstant(OP_BASE_INVOKE, name);
 		emitByte(argCount);
+		emitSelector(AS_STRING(currentChunk()->constants->values[name]));
 	} else {
 		namedVariable(syntheticToken("base"), false);
 		emitOpAndConstant(OP_GET_BASE, name);
@@ -857,8 +1030,10 @@ static void braceError(bool canAssign) {
 ParseRule rules[] = {
 	[TOKEN_LEFT_PAREN]= {grouping,call,PREC_CALL},
 	[TOKEN_RIGHT_PAREN]= {parenError,NULL,PREC_NONE},
-	[TOKEN_LEFT_BRACE]= {NULL,NULL,PREC_NONE},
+	[TOKEN_LEFT_BRACE]= {map,NULL,PREC_NONE},
 	[TOKEN_RIGHT_BRACE]= {braceError,NULL,PREC_NONE},
+	[TOKEN_LEFT_BRACKET]= {list,subscript,PREC_CALL},
+	[TOKEN_RIGHT_BRACKET]= {NULL,NULL,PREC_NONE},
 	[TOKEN_COMMA]= {NULL,NULL,PREC_NONE},
 	[TOKEN_DOT]= {NULL,dot,PREC_CALL},
 	[TOKEN_MINUS]= {unary,binary,PREC_TERM},
@@ -903,8 +1078,9 @@ ParseRule rules[] = {
 	[TOKEN_EOF]= {NULL,NULL,PREC_NONE},
 	[TOKEN_INTERPOLATION] = {interpolation, NULL, PREC_NONE},
 	[TOKEN_NL] = {newline, NULL, PREC_NONE},
-	[TOKEN_CONCAT] = {NULL, binary, PREC_INTERPOLATION},
+	[TOKEN_CONCAT] = {NULL, NULL, PREC_NONE},
 	[TOKEN_MOD] = {NULL, binary, PREC_FACTOR},
+	[TOKEN_DIV] = {NULL, binary, PREC_FACTOR},
 	[TOKEN_PERCENT] = {NULL, binary, PREC_FACTOR},
 };
 
@@ -1005,8 +1181,17 @@ static void function(FunctionType type) {
 /* parse and emit instructions for a class method. */
 static void method() {
 	consume(TOKEN_IDENTIFIER, "Expect method name.");
-	int constant = identifierConstantDeclaration(&parser.previous, true, true);
+	int constant = nameConstant(&parser.previous);
+	ObjString* name = AS_STRING(currentChunk()->constants->values[constant]);
+	for (int i = 0; i < cmi.count; i++) {
+		if (AS_STRING(currentChunk()->constants->values[cmi.index[i]]) == name) {
+			error("Attempt to re-declare a method of the same class.");
+		}
+	}
+	if (cmi.count == cmi.capacity) growCMI(&cmi);
 	cmi.index[cmi.count++] = constant;
+	// claim the selector now, the class' vtable is built from it at runtime.
+	selector(name);
 	
 	FunctionType type = TYPE_METHOD;
 	if (parser.previous.length == 4 && memcmp(parser.previous.start, "init", 4) == 0) {
@@ -1025,7 +1210,7 @@ static void classDeclaration() {
 	initCMI(&cmi);
 	consume(TOKEN_IDENTIFIER, "Expect class name.");
 	Token className = parser.previous;
-	uint8_t nameConstant = identifierConstantDeclaration(&parser.previous, true, false);
+	int nameConstant = identifierConstantDeclaration(&parser.previous, true);
 	declareVariable(true);
 	
 	emitOpAndConstant(OP_CLASS, nameConstant);
@@ -1059,15 +1244,13 @@ static void classDeclaration() {
 		method();
 	}
 	consume(TOKEN_RIGHT_BRACE, "Expect '}' after class body.");
+	emitByte(OP_END_CLASS);
 	emitByte(OP_POP);
 	
 	if (classCompiler.hasBaseClass) {
 		endScope();
 	}
 	
-	for (int i = 0; i < cmi.count; i++) {
-		currentChunk()->constants->values[cmi.index[i]].isConst = false;	
-	}
 	freeCMI(&cmi);
 	
 	currentClass = currentClass->enclosing;
@@ -1075,7 +1258,7 @@ static void classDeclaration() {
 
 /* add the function name to the 'globalConstantIndex' hash map. */
 static void functionDeclaration() {
-	uint8_t global = parseVariable("Expect function name.", true);
+	int global = parseVariable("Expect function name.", true);
 	markInitialized();
 	function(TYPE_FUNCTION);
 	defineVariable(global);
@@ -1139,21 +1322,202 @@ static void continueStatement(controlFlow* controls) {
 /* In the code for loop and switch statments (following this comment), you'd notice a variable controlFlow. Break or continue statements could happen anywhere within a loop or switch statment (cases for example) and this variable holds the break or continue points to be resolved or 'patched' (recall patchJump()?) later on at the appropriate time (Mostly at the end of the function parsing the respective statement.). */ 
 
 int loopLevel = 0; // number of nestings of loop statements
+
+/* emit a call of the method 'name' on the receiver and arguments already pushed. */
+static void emitInvoke(const char* name, uint8_t argCount) {
+	ObjString* method = allocateString(false, name, (int)strlen(name));
+	emitOpAndConstant(OP_INVOKE, addConstant(currentChunk(), OBJ_VAL(method), false));
+	emitByte(argCount);
+	emitSelector(method);
+}
+
+/* parse the body of a for-in or counted loop: a block, or the statements up to the end of the line. */
+static void loopBody(controlFlow* controls) {
+	if (parser.current.type == TOKEN_LEFT_BRACE) {
+		declaration(controls);
+	} else {
+		while(!scannedPastNewLine && parser.current.type != TOKEN_EOF) {
+			declaration(controls);
+			if (breakGlobal == 1) {
+				continueParsingOnBreak1();
+			}
+		}
+	}
+	
+	if (breakGlobal == 1) breakGlobal = 0;
+}
+
+/* whether the for-in sequence is a call of the range() native, which isn't shadowed by a local. */
+static bool rangeCall() {
+	Token name = parser.current;
+	if (name.type != TOKEN_IDENTIFIER || name.length != 5 || memcmp(name.start, "range", 5) != 0) return false;
+	if (peekToken().type != TOKEN_LEFT_PAREN) return false;
+	return unshadowed(&name);
+}
+
+/* emit instructions for a counted loop, 'for (x in range(start, end, step))'. No range object is made: the range() arguments become three hidden locals, the counter, the end and the step, right below the loop variable. OP_FOR_PREP fills in the missing arguments and skips the loop if it's empty, then OP_FOR_STEP at the bottom adds the step, tests against the end and jumps back to the body in one dispatch. */
+static void countedLoop(Token loopVariableName) {
+	advance(); // 'range'
+	advance(); // '('
+	
+	beginScope();
+	uint8_t argCount = argumentList();
+	if (argCount < 1 || argCount > 3) {
+		error("'range' expects 1 to 3 numbers.");
+	}
+	consume(TOKEN_RIGHT_PAREN, "Expect ')' after 'for' sequence.");
+	
+	int counterSlot = current->localCount;
+	addLocal(syntheticToken("for counter"), false);
+	markInitialized();
+	addLocal(syntheticToken("for end"), true);
+	markInitialized();
+	addLocal(syntheticToken("for step"), true);
+	markInitialized();
+	addLocal(loopVariableName, false);
+	markInitialized();
+	if (current->localCount > UINT8_MAX) {
+		error("Too many local variables in function.");
+	}
+	
+	emitByte(OP_FOR_PREP);
+	emitByte((uint8_t)counterSlot);
+	emitByte(argCount);
+	emitByte(0xff);
+	emitByte(0xff);
+	int exitJump = currentChunk()->count - 2;
+	int bodyStart = currentChunk()->count;
+	
+	controlFlow controls;
+	initControlFlow(&controls);
+	
+	loopLevel++;
+	loopBody(&controls);
+	
+	for (int i = 0; i < controls.cpCount; i++) {
+		patchJump(controls.continuePoint[i]);
+	}
+	
+	emitByte(OP_FOR_STEP);
+	emitByte((uint8_t)counterSlot);
+	int offset = currentChunk()->count - bodyStart + 2;
+	if (offset > UINT16_MAX) error("Loop body too large.");
+	emitByte((offset >> 8) & 0xff);
+	emitByte(offset & 0xff);
+	
+	patchJump(exitJump);
+	for (int i = 0; i < controls.count; i++) {
+		patchJump(controls.exits[i]);
+	}
+	
+	endScope();
+	freeControlFlow(&controls);
+	loopLevel--;
+}
+
+/* emit instructions for for-in statements, 'for (x in sequence)'. The sequence and the iteration state sit in two hidden locals right below the loop variable, and OP_ITER_NEXT at the bottom of the loop steps them: for lists, maps, strings, ranges and Float64Arrays it stores the next element in the loop variable and jumps back to the body in one dispatch. For instances it skips to the method protocol after it: state = sequence.iterate(state), with null for the first call, until iterate() returns false or null, and x = sequence.iteratorValue(state). */
+static void forInStatement() {
+	Token loopVariableName = parser.current;
+	advance();
+	consume(TOKEN_IN, "Expect 'in' after loop variable.");
+	if (rangeCall()) {
+		countedLoop(loopVariableName);
+		return;
+	}
+	
+	beginScope();
+	expression();
+	consume(TOKEN_RIGHT_PAREN, "Expect ')' after 'for' sequence.");
+	
+	int sequenceSlot = current->localCount;
+	addLocal(syntheticToken("for sequence"), true);
+	markInitialized();
+	emitByte(OP_NULL);
+	addLocal(syntheticToken("for state"), false);
+	markInitialized();
+	emitByte(OP_NULL);
+	addLocal(loopVariableName, false);
+	markInitialized();
+	if (current->localCount > UINT8_MAX) {
+		error("Too many local variables in function.");
+	}
+	
+	controlFlow controls;
+	initControlFlow(&controls);
+	
+	int nextJump = emitJump(OP_JUMP);
+	int bodyStart = currentChunk()->count;
+	
+	loopLevel++;
+	loopBody(&controls);
+	
+	patchJump(nextJump);
+	for (int i = 0; i < controls.cpCount; i++) {
+		patchJump(controls.continuePoint[i]);
+	}
+	
+	emitByte(OP_ITER_NEXT);
+	emitByte((uint8_t)sequenceSlot);
+	int offset = currentChunk()->count - bodyStart + 2;
+	if (offset > UINT16_MAX) error("Loop body too large.");
+	emitByte((offset >> 8) & 0xff);
+	emitByte(offset & 0xff);
+	int exitJump = emitJump(OP_JUMP);
+	
+	// the method protocol for instances.
+	emitByte(OP_GET_LOCAL);
+	emitByte((uint8_t)sequenceSlot);
+	emitByte(OP_GET_LOCAL);
+	emitByte((uint8_t)(sequenceSlot + 1));
+	emitInvoke("iterate", 1);
+	emitByte(OP_SET_LOCAL);
+	emitByte((uint8_t)(sequenceSlot + 1));
+	int doneJump = emitJump(OP_JUMP_IF_FALSE);
+	emitByte(OP_POP);
+	emitByte(OP_GET_LOCAL);
+	emitByte((uint8_t)sequenceSlot);
+	emitByte(OP_GET_LOCAL);
+	emitByte((uint8_t)(sequenceSlot + 1));
+	emitInvoke("iteratorValue", 1);
+	emitByte(OP_SET_LOCAL);
+	emitByte((uint8_t)(sequenceSlot + 2));
+	emitByte(OP_POP);
+	emitLoop(bodyStart);
+	
+	patchJump(doneJump);
+	emitByte(OP_POP);
+	patchJump(exitJump);
+	
+	for (int i = 0; i < controls.count; i++) {
+		patchJump(controls.exits[i]);
+	}
+	
+	endScope();
+	freeControlFlow(&controls);
+	loopLevel--;
+}
+
 /* emit instructions for for statments. */
 static void forStatement() {
+	consume(TOKEN_LEFT_PAREN, "Expect '(' after 'for' token.");
+	bool declaresVariable = match(TOKEN_VAR);
+	if (check(TOKEN_IDENTIFIER) && peekToken().type == TOKEN_IN) {
+		forInStatement();
+		return;
+	}
+	
 	beginScope();
 	
 	int loopVariableSlot = -1;
 	Token loopVariableName;
 	loopVariableName.start = NULL;
 	
-	consume(TOKEN_LEFT_PAREN, "Expect '(' after 'for' token.");
-	if (match(TOKEN_SEMICOLON)) {
-		// No initializer
-	} else if (match(TOKEN_VAR)) {
+	if (declaresVariable) {
 		loopVariableName = parser.current;
 		varDeclaration(false);
 		loopVariableSlot = current->localCount - 1;
+	} else if (match(TOKEN_SEMICOLON)) {
+		// No initializer
 	} else {
 		expressionStatement();
 	}
@@ -1529,16 +1893,6 @@ static void statement(controlFlow* controls) {
 	}
 }
 
-/* add native function names to the 'globalConstantIndex' hash map at the start of compilation so they can identified later during parsing. */ 
-static void addNativeIdentifiers() {
-	for (int i = 0; i < vm.nativeIdentifierCount; i++) {
-		ObjString* key = allocateString(false, vm.nativeIdentifiers[i], strlen(vm.nativeIdentifiers[i]));
-		int index = addConstant(currentChunk(), OBJ_VAL(key), true);
-		
-		tableSet(&vm.globalConstantIndex, &OBJ_KEY(key), NUMBER_VAL(index));
-	}
-}
-
 /* compile a source file. */
 ObjFunction* compile(const char* source, size_t len, bool REPLmode, bool withinREPL) {
 	initValueArray(&constants);
@@ -1546,7 +1900,6 @@ ObjFunction* compile(const char* source, size_t len, bool REPLmode, bool withinR
 	initScanner(source, len);
 	Compiler compiler;
 	initCompiler(&compiler, TYPE_SCRIPT, &constants);
-	addNativeIdentifiers();
 	//controlFlow* controls;
 	
 	parser.hadError = false;
@@ -1570,7 +1923,6 @@ ObjFunction* compileREPL(const char* source, size_t len, bool REPLmode, bool wit
 	initScanner(source, len);
 	Compiler compiler;
 	initCompiler(&compiler, TYPE_SCRIPT, &constants);
-	if (!withinREPL) addNativeIdentifiers();
 	
 	parser.hadError = false;
 	parser.panicMode = false;
@@ -1584,6 +1936,15 @@ ObjFunction* compileREPL(const char* source, size_t len, bool REPLmode, bool wit
 	return parser.hadError ? NULL : function;
 }
 
+/* drop the compiler state of a compilation that was unwound by an out-of-memory error. */
+void resetCompiler() {
+	current = NULL;
+	currentClass = NULL;
+	breakGlobal = 0;
+	loopLevel = 0;
+	switchLevel = 0;
+}
+
 void markCompilerRoots() {
 	Compiler* compiler = current;
 	while (compiler != NULL) {
@@ -1591,3 +1952,12 @@ void markCompilerRoots() {
 		compiler = compiler->enclosing;
 	}
 }
+
+/* point the compiler roots at their new addresses after a heap compaction. */
+void forwardCompilerRoots() {
+	Compiler* compiler = current;
+	while (compiler != NULL) {
+		compiler->function = (ObjFunction*)forwardObject((Obj*)compiler->function);
+		compiler = compiler->enclosing;
+	}
+}
@@ -7,5 +7,7 @@
 ObjFunction* compile(const char* source, size_t len, bool REPLmode, bool withinREPL);
 ObjFunction* compileREPL(const char* source, size_t len, bool REPLmode, bool withinREPL);
 void markCompilerRoots();
+void resetCompiler();
+void forwardCompilerRoots();
 
 #endif
@@ -1,6 +1,7 @@
 #include <stdio.h>
 
 #include "debug.h"
+#include "native.h"
 #include "object.h"
 #include "value.h"
 
@@ -22,6 +23,28 @@ static int jumpInstruction(const char* name, int sign, Chunk* chunk, int offset)
 	return offset + 3;
 }
 
+static int iterInstruction(const char* name, Chunk* chunk, int offset) {
+	uint8_t slot = chunk->code[offset + 1];
+	uint16_t jump = (uint16_t)(chunk->code[offset + 2] << 8 | chunk->code[offset + 3]);
+	printf("%-16s %14d -> %d\n", name, slot, offset + 4 - jump);
+	return offset + 4;
+}
+
+static int forPrepInstruction(const char* name, Chunk* chunk, int offset) {
+	uint8_t slot = chunk->code[offset + 1];
+	uint8_t argCount = chunk->code[offset + 2];
+	uint16_t jump = (uint16_t)(chunk->code[offset + 3] << 8 | chunk->code[offset + 4]);
+	printf("%-16s (%d args) %14d -> %d\n", name, argCount, slot, offset + 5 + jump);
+	return offset + 5;
+}
+
+static int mathInstruction(const char* name, Chunk* chunk, int offset) {
+	uint8_t function = chunk->code[offset + 1];
+	uint8_t argCount = chunk->code[offset + 2];
+	printf("%-16s (%d args) %14s\n", name, argCount, mathFunctionName((MathFunction)function));
+	return offset + 3;
+}
+
 static int popNInstruction(const char* name, Chunk* chunk, int offset) {
 	uint8_t popCount = chunk->code[offset + 1];
 	printf("%-16s %14d\n", name, popCount);
@@ -36,13 +59,17 @@ static int constantInstruction(const char* name, Chunk* chunk, int offset) {
 	return offset + 2;
 }
 
-static int invokeInstruction(const char* name, Chunk* chunk, int offset) {
-	uint8_t constant = chunk->code[offset + 1];
-	uint8_t argCount = chunk->code[offset + 2];
+/* 'width' is the size of the constant operand, 1 or 3 bytes for the '_LONG' variant. */
+static int invokeInstruction(const char* name, int width, Chunk* chunk, int offset) {
+	uint32_t constant = chunk->code[offset + 1];
+	if (width == 3) constant |= chunk->code[offset + 2] << 8 | chunk->code[offset + 3] << 16;
+	offset += width;
+	uint8_t argCount = chunk->code[offset + 1];
+	uint16_t selector = (uint16_t)(chunk->code[offset + 2] << 8 | chunk->code[offset + 3]);
 	printf("%-16s (%d args) %14d '", name, argCount, constant);
 	printValue(chunk->constants->values[constant]);
-	printf("'\n");
-	return offset + 3;
+	printf("' #%d\n", selector);
+	return offset + 4;
 }
 
 static int constantLongInstruction(const char* name, Chunk* chunk, int offset) {
@@ -90,22 +117,12 @@ int disassembleInstruction(Chunk* chunk, int offset) {
 			return byteInstruction("OP_GET_LOCAL", chunk, offset);
 		case OP_SET_LOCAL:
 			return byteInstruction("OP_SET_LOCAL", chunk, offset); 
-		case OP_GET_GLOBAL: {
-			if (chunk->constants->count < 256) {
-				return constantInstruction("OP_GET_GLOBAL", chunk, offset);	
-			}
-			return constantLongInstruction("OP_GET_GLOBAL", chunk, offset);
-		}
+		case OP_GET_GLOBAL:
+			return constantInstruction("OP_GET_GLOBAL", chunk, offset);
 		case OP_DEFINE_GLOBAL:
-			if (chunk->constants->count < 256) {
-				return constantInstruction("OP_DEFINE_GLOBAL", chunk, offset);;	
-			}
-			return constantLongInstruction("OP_DEFINE_GLOBAL", chunk, offset);
+			return constantInstruction("OP_DEFINE_GLOBAL", chunk, offset);
 		case OP_SET_GLOBAL:
-			if (chunk->constants->count < 256) {
-				return constantInstruction("OP_SET_GLOBAL", chunk, offset);;	
-			}
-			return constantLongInstruction("OP_SET_GLOBAL", chunk, offset);
+			return constantInstruction("OP_SET_GLOBAL", chunk, offset);
 		case OP_GET_UPVALUE:
 			return byteInstruction("OP_GET_UPVALUE", chunk, offset);
 		case OP_SET_UPVALUE:
@@ -114,6 +131,10 @@ int disassembleInstruction(Chunk* chunk, int offset) {
 			return constantInstruction("OP_GET_PROPERTY", chunk, offset);
 		case OP_SET_PROPERTY:
 			return constantInstruction("OP_SET_PROPERTY", chunk, offset);
+		case OP_INDEX_GET:
+			return simpleInstruction("OP_INDEX_GET", offset);
+		case OP_INDEX_SET:
+			return simpleInstruction("OP_INDEX_SET", offset);
 		case OP_GET_BASE:
 			return constantInstruction("OP_GET_BASE", chunk, offset);
 		case OP_DELATTR:
@@ -136,6 +157,12 @@ int disassembleInstruction(Chunk* chunk, int offset) {
 			return simpleInstruction("OP_TERNARY", offset);
 		case OP_ADD:
 			return simpleInstruction("OP_ADD", offset);
+		case OP_BUILD_STRING:
+			return byteInstruction("OP_BUILD_STRING", chunk, offset);
+		case OP_BUILD_LIST:
+			return byteInstruction("OP_BUILD_LIST", chunk, offset);
+		case OP_BUILD_MAP:
+			return byteInstruction("OP_BUILD_MAP", chunk, offset);
 		case OP_SUBTRACT:
 			return simpleInstruction("OP_SUBTRACT", offset);
 		case OP_MULTIPLY:
@@ -144,6 +171,8 @@ int disassembleInstruction(Chunk* chunk, int offset) {
 			return simpleInstruction("OP_DIVIDE", offset);
 		case OP_MOD:
 			return simpleInstruction("OP_MOD", offset);
+		case OP_INT_DIVIDE:
+			return simpleInstruction("OP_INT_DIVIDE", offset);
 		case OP_PERCENT:
 			return simpleInstruction("OP_PERCENT", offset);
 		case OP_NOT:
@@ -158,6 +187,12 @@ int disassembleInstruction(Chunk* chunk, int offset) {
 			return jumpInstruction("OP_JUMP_IF_FALSE", 1, chunk, offset);
 		case OP_LOOP:
 			return jumpInstruction("OP_LOOP", -1, chunk, offset);
+		case OP_ITER_NEXT:
+			return iterInstruction("OP_ITER_NEXT", chunk, offset);
+		case OP_FOR_PREP:
+			return forPrepInstruction("OP_FOR_PREP", chunk, offset);
+		case OP_FOR_STEP:
+			return iterInstruction("OP_FOR_STEP", chunk, offset);
 		case OP_CONTINUE:
 			return jumpInstruction("OP_CONTINUE", 1, chunk, offset);
 		/*case OP_BREAK:
@@ -170,18 +205,25 @@ int disassembleInstruction(Chunk* chunk, int offset) {
 			return simpleInstruction("OP_FALLTHROUGH", offset);
 		case OP_CALL:
 			return byteInstruction("OP_CALL", chunk, offset);
+		case OP_MATH:
+			return mathInstruction("OP_MATH", chunk, offset);
 		case OP_INVOKE:	 {
-			return invokeInstruction("OP_INVOKE", chunk, offset);
+			return invokeInstruction("OP_INVOKE", 1, chunk, offset);
 		}
 		
 		case OP_BASE_INVOKE: {
-			return invokeInstruction("OP_SUPER_INVOKE", chunk, offset);
+			return invokeInstruction("OP_SUPER_INVOKE", 1, chunk, offset);
 		}
 		
-		case OP_CLOSURE: {
+		case OP_CLOSURE:
+		case OP_CLOSURE_LONG: {
+			uint32_t constant = chunk->code[++offset];
+			if (instruction == OP_CLOSURE_LONG) {
+				constant |= chunk->code[offset + 1] << 8 | chunk->code[offset + 2] << 16;
+				offset += 2;
+			}
 			offset++;
-			uint8_t constant = chunk->code[offset++];
-			printf("%-16s %14d ", "OP_CLOSURE", constant);
+			printf("%-16s %14d ", instruction == OP_CLOSURE_LONG ? "OP_CLOSURE_LONG" : "OP_CLOSURE", constant);
 			printValue(chunk->constants->values[constant]);
 			printf("\n");
 			
@@ -204,6 +246,28 @@ int disassembleInstruction(Chunk* chunk, int offset) {
 			return simpleInstruction("OP_INHERIT", offset);
 		case OP_METHOD:
 			return constantInstruction("OP_METHOD", chunk, offset);
+		case OP_END_CLASS:
+			return simpleInstruction("OP_END_CLASS", offset);
+		case OP_GET_GLOBAL_LONG:
+			return constantLongInstruction("OP_GET_GLOBAL_LONG", chunk, offset);
+		case OP_DEFINE_GLOBAL_LONG:
+			return constantLongInstruction("OP_DEFINE_GLOBAL_LONG", chunk, offset);
+		case OP_SET_GLOBAL_LONG:
+			return constantLongInstruction("OP_SET_GLOBAL_LONG", chunk, offset);
+		case OP_GET_PROPERTY_LONG:
+			return constantLongInstruction("OP_GET_PROPERTY_LONG", chunk, offset);
+		case OP_SET_PROPERTY_LONG:
+			return constantLongInstruction("OP_SET_PROPERTY_LONG", chunk, offset);
+		case OP_GET_BASE_LONG:
+			return constantLongInstruction("OP_GET_BASE_LONG", chunk, offset);
+		case OP_INVOKE_LONG:
+			return invokeInstruction("OP_INVOKE_LONG", 3, chunk, offset);
+		case OP_BASE_INVOKE_LONG:
+			return invokeInstruction("OP_SUPER_INVOKE_LONG", 3, chunk, offset);
+		case OP_CLASS_LONG:
+			return constantLongInstruction("OP_CLASS_LONG", chunk, offset);
+		case OP_METHOD_LONG:
+			return constantLongInstruction("OP_METHOD_LONG", chunk, offset);
 		default:
 			printf("Unknown opcode %d\n", instruction);
 			return offset + 1;
@@ -0,0 +1,268 @@
+#include <math.h>
+#include <stdlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+
+#include "float64.h"
+
+/* Sums use two vector accumulators (four partial sums) to hide the add latency, so they can differ from a left-to-right sum in the last bits. */
+double float64Sum(const double* a, int count) {
+	int i = 0;
+	double sum = 0;
+#ifdef __SSE2__
+	__m128d acc0 = _mm_setzero_pd();
+	__m128d acc1 = _mm_setzero_pd();
+	for (; i + 4 <= count; i += 4) {
+		acc0 = _mm_add_pd(acc0, _mm_loadu_pd(a + i));
+		acc1 = _mm_add_pd(acc1, _mm_loadu_pd(a + i + 2));
+	}
+	acc0 = _mm_add_pd(acc0, acc1);
+	sum = _mm_cvtsd_f64(acc0) + _mm_cvtsd_f64(_mm_unpackhi_pd(acc0, acc0));
+#endif
+	for (; i < count; i++) {
+		sum += a[i];
+	}
+	return sum;
+}
+
+double float64Dot(const double* a, const double* b, int count) {
+	int i = 0;
+	double sum = 0;
+#ifdef __SSE2__
+	__m128d acc0 = _mm_setzero_pd();
+	__m128d acc1 = _mm_setzero_pd();
+	for (; i + 4 <= count; i += 4) {
+		acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+		acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+	}
+	acc0 = _mm_add_pd(acc0, acc1);
+	sum = _mm_cvtsd_f64(acc0) + _mm_cvtsd_f64(_mm_unpackhi_pd(acc0, acc0));
+#endif
+	for (; i < count; i++) {
+		sum += a[i] * b[i];
+	}
+	return sum;
+}
+
+/* Smallest element, NaN if the array holds one. 'count' must be at least 1. */
+double float64Min(const double* a, int count) {
+	int i = 0;
+	double min = a[0];
+	bool nan = false;
+#ifdef __SSE2__
+	if (count >= 2) {
+		__m128d acc = _mm_loadu_pd(a);
+		__m128d unordered = _mm_cmpunord_pd(acc, acc);
+		for (i = 2; i + 2 <= count; i += 2) {
+			__m128d x = _mm_loadu_pd(a + i);
+			unordered = _mm_or_pd(unordered, _mm_cmpunord_pd(x, x));
+			acc = _mm_min_pd(acc, x);
+		}
+		nan = _mm_movemask_pd(unordered) != 0;
+		double low = _mm_cvtsd_f64(acc);
+		double high = _mm_cvtsd_f64(_mm_unpackhi_pd(acc, acc));
+		min = low < high ? low : high;
+	}
+#endif
+	for (; i < count; i++) {
+		if (isnan(a[i])) nan = true;
+		if (a[i] < min) min = a[i];
+	}
+	return nan ? NAN : min;
+}
+
+/* Largest element, NaN if the array holds one. 'count' must be at least 1. */
+double float64Max(const double* a, int count) {
+	int i = 0;
+	double max = a[0];
+	bool nan = false;
+#ifdef __SSE2__
+	if (count >= 2) {
+		__m128d acc = _mm_loadu_pd(a);
+		__m128d unordered = _mm_cmpunord_pd(acc, acc);
+		for (i = 2; i + 2 <= count; i += 2) {
+			__m128d x = _mm_loadu_pd(a + i);
+			unordered = _mm_or_pd(unordered, _mm_cmpunord_pd(x, x));
+			acc = _mm_max_pd(acc, x);
+		}
+		nan = _mm_movemask_pd(unordered) != 0;
+		double low = _mm_cvtsd_f64(acc);
+		double high = _mm_cvtsd_f64(_mm_unpackhi_pd(acc, acc));
+		max = low > high ? low : high;
+	}
+#endif
+	for (; i < count; i++) {
+		if (isnan(a[i])) nan = true;
+		if (a[i] > max) max = a[i];
+	}
+	return nan ? NAN : max;
+}
+
+void float64Scale(double* a, double factor, int count) {
+	int i = 0;
+#ifdef __SSE2__
+	__m128d k = _mm_set1_pd(factor);
+	for (; i + 2 <= count; i += 2) {
+		_mm_storeu_pd(a + i, _mm_mul_pd(_mm_loadu_pd(a + i), k));
+	}
+#endif
+	for (; i < count; i++) {
+		a[i] *= factor;
+	}
+}
+
+/* a[i] += b[i]. */
+void float64Add(double* a, const double* b, int count) {
+	int i = 0;
+#ifdef __SSE2__
+	for (; i + 2 <= count; i += 2) {
+		_mm_storeu_pd(a + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+	}
+#endif
+	for (; i < count; i++) {
+		a[i] += b[i];
+	}
+}
+
+void float64AddScalar(double* a, double addend, int count) {
+	int i = 0;
+#ifdef __SSE2__
+	__m128d k = _mm_set1_pd(addend);
+	for (; i + 2 <= count; i += 2) {
+		_mm_storeu_pd(a + i, _mm_add_pd(_mm_loadu_pd(a + i), k));
+	}
+#endif
+	for (; i < count; i++) {
+		a[i] += addend;
+	}
+}
+
+/* In place running total: a[i] becomes a[0] + ... + a[i]. Each pair is scanned in registers, [x0, x0 + x1], then offset by the total carried from the pairs before it. */
+void float64PrefixSum(double* a, int count) {
+	int i = 0;
+	double total = 0;
+#ifdef __SSE2__
+	__m128d carry = _mm_setzero_pd();
+	for (; i + 2 <= count; i += 2) {
+		__m128d x = _mm_loadu_pd(a + i);
+		x = _mm_add_pd(x, _mm_unpacklo_pd(_mm_setzero_pd(), x));
+		x = _mm_add_pd(x, carry);
+		_mm_storeu_pd(a + i, x);
+		carry = _mm_unpackhi_pd(x, x);
+	}
+	total = _mm_cvtsd_f64(carry);
+#endif
+	for (; i < count; i++) {
+		total += a[i];
+		a[i] = total;
+	}
+}
+
+// ascending, with NaNs last so the order is total.
+static int compareDoubles(const void* a, const void* b) {
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	if (isnan(x)) return isnan(y) ? 0 : 1;
+	if (isnan(y)) return -1;
+	return (x > y) - (x < y);
+}
+
+void float64Sort(double* a, int count) {
+	qsort(a, count, sizeof(double), compareDoubles);
+}
+
+void float64Sqrt(double* a, int count) {
+	int i = 0;
+#ifdef __SSE2__
+	for (; i + 2 <= count; i += 2) {
+		_mm_storeu_pd(a + i, _mm_sqrt_pd(_mm_loadu_pd(a + i)));
+	}
+#endif
+	for (; i < count; i++) {
+		a[i] = sqrt(a[i]);
+	}
+}
+
+/* Clears the sign bits. */
+void float64Abs(double* a, int count) {
+	int i = 0;
+#ifdef __SSE2__
+	__m128d sign = _mm_set1_pd(-0.0);
+	for (; i + 2 <= count; i += 2) {
+		_mm_storeu_pd(a + i, _mm_andnot_pd(sign, _mm_loadu_pd(a + i)));
+	}
+#endif
+	for (; i < count; i++) {
+		a[i] = fabs(a[i]);
+	}
+}
+
+/* Rounding needs SSE4.1, otherwise these are left to the compiler. */
+void float64Floor(double* a, int count) {
+	int i = 0;
+#ifdef __SSE4_1__
+	for (; i + 2 <= count; i += 2) {
+		_mm_storeu_pd(a + i, _mm_floor_pd(_mm_loadu_pd(a + i)));
+	}
+#endif
+	for (; i < count; i++) {
+		a[i] = floor(a[i]);
+	}
+}
+
+void float64Ceil(double* a, int count) {
+	int i = 0;
+#ifdef __SSE4_1__
+	for (; i + 2 <= count; i += 2) {
+		_mm_storeu_pd(a + i, _mm_ceil_pd(_mm_loadu_pd(a + i)));
+	}
+#endif
+	for (; i < count; i++) {
+		a[i] = ceil(a[i]);
+	}
+}
+
+/* a[i] = min(a[i], bound). minpd returns its second operand when either is NaN, so the bound goes first and NaN elements stay NaN. */
+void float64MinScalar(double* a, double bound, int count) {
+	int i = 0;
+#ifdef __SSE2__
+	__m128d k = _mm_set1_pd(bound);
+	for (; i + 2 <= count; i += 2) {
+		_mm_storeu_pd(a + i, _mm_min_pd(k, _mm_loadu_pd(a + i)));
+	}
+#endif
+	for (; i < count; i++) {
+		a[i] = bound < a[i] ? bound : a[i];
+	}
+}
+
+void float64MaxScalar(double* a, double bound, int count) {
+	int i = 0;
+#ifdef __SSE2__
+	__m128d k = _mm_set1_pd(bound);
+	for (; i + 2 <= count; i += 2) {
+		_mm_storeu_pd(a + i, _mm_max_pd(k, _mm_loadu_pd(a + i)));
+	}
+#endif
+	for (; i < count; i++) {
+		a[i] = bound > a[i] ? bound : a[i];
+	}
+}
+
+/* a[i] = function(a[i]), for the libm functions without a vector form. */
+void float64Map(double* a, double (*function)(double), int count) {
+	for (int i = 0; i < count; i++) {
+		a[i] = function(a[i]);
+	}
+}
+
+/* a[i] = function(a[i], x). */
+void float64MapScalar(double* a, double (*function)(double, double), double x, int count) {
+	for (int i = 0; i < count; i++) {
+		a[i] = function(a[i], x);
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef olive_float64_h
+#define olive_float64_h
+
+#include "common.h"
+
+/* Bulk kernels over raw arrays of doubles, used by the Float64Array natives. They work two lanes at a time with SSE2 where available. */
+
+double float64Sum(const double* a, int count);
+double float64Dot(const double* a, const double* b, int count);
+double float64Min(const double* a, int count);
+double float64Max(const double* a, int count);
+void float64Scale(double* a, double factor, int count);
+void float64Add(double* a, const double* b, int count);
+void float64AddScalar(double* a, double addend, int count);
+void float64PrefixSum(double* a, int count);
+void float64Sort(double* a, int count);
+void float64Sqrt(double* a, int count);
+void float64Abs(double* a, int count);
+void float64Floor(double* a, int count);
+void float64Ceil(double* a, int count);
+void float64MinScalar(double* a, double bound, int count);
+void float64MaxScalar(double* a, double bound, int count);
+void float64Map(double* a, double (*function)(double), int count);
+void float64MapScalar(double* a, double (*function)(double, double), double x, int count);
+
+#endif
@@ -4,8 +4,9 @@
 #include <stdio.h>
 
 #include "common.h"
+#include "memory.h"
 #include "vm.h"
-#include "dynamic_array.h"
+#include "arena.h"
 
 char* welcome_text = {
 "        888\n"
@@ -22,8 +23,6 @@ char* version_text2 = {"\nCopyright(C) 2023 wldfngrs, https://github.com/wldfngr
 
 bool REPLmode = false;
 bool withinREPL = false;
-int currentLength = 0;
-int prevLength = 0;
 
 static void printGCCVersionDateAndTime() {
 	FILE* date = popen("date", "r");
@@ -54,36 +53,36 @@ static bool quit(char* line) {
 	return false;
 }
 
-// modify hardcoded line limit
 static void repl() {
 	REPLmode = true;
 	printf("%s\n", welcome_text);
 	printGCCVersionDateAndTime();
-	char line[1024];
-	DA da_line;
-	initDynamicArray(&da_line);
+	char* line = NULL;
+	size_t lineCapacity = 0;
+	Arena source;
+	initArena(&source);
 	for(;;) {
 		printf("> ");
 		
-		if (!fgets(line, sizeof(line), stdin)) {
+		ssize_t length = getline(&line, &lineCapacity, stdin);
+		if (length < 0) {
 			printf("\n");
 			break;
 		}
 		
-		appendDynamicArray(&da_line, line);
-		currentLength = da_line.count;
-
 		if (quit(line)) {
 			withinREPL = false;
 			printf("Exiting Olive...\n\n");
 			break;
 		}
 		
-		interpret(da_line.array + prevLength, currentLength - prevLength, REPLmode, &withinREPL);
-		prevLength = currentLength;
+		// the compiled code borrows its strings from the source, which has to outlive the line buffer. Like runFile(), pass the index of the last character.
+		const char* code = arenaAppend(&source, line, length);
+		interpret(code, length - 1, REPLmode, &withinREPL);
 	}
 	
-	freeDynamicArray(&da_line);
+	free(line);
+	freeArena(&source);
 }
 
 static int checkExtension(const char* path) {
@@ -147,16 +146,65 @@ static void runFile(const char* path) {
 	if (result == INTERPRET_RUNTIME_ERROR) exit(70);
 }
 
+/* GC tuning, read from the environment first so that command line flags override it. */
+static const char* gcEnvironment[][2] = {
+	{"OLIVE_GC_INITIAL", "initial"},
+	{"OLIVE_GC_GROW", "grow"},
+	{"OLIVE_GC_MAX", "max"},
+	{"OLIVE_GC_INTERVAL", "interval"},
+	{"OLIVE_GC_LOG", "log"},
+};
+
+static void usage() {
+	fprintf(stderr, "Usage: olive [--gc-initial=SIZE] [--gc-grow=FACTOR] [--gc-max=SIZE] [--gc-interval=SIZE] [--gc-log] [path]\n");
+	exit(64);
+}
+
+static void configureGC() {
+	for (size_t i = 0; i < sizeof(gcEnvironment) / sizeof(gcEnvironment[0]); i++) {
+		const char* value = getenv(gcEnvironment[i][0]);
+		if (value != NULL && !setGCOption(gcEnvironment[i][1], value)) {
+			fprintf(stderr, "\e[1;31mInvalid value '%s' for %s.\n\e[0m", value, gcEnvironment[i][0]);
+			exit(64);
+		}
+	}
+}
+
+/* parse a '--gc-NAME[=VALUE]' flag. */
+static void parseGCFlag(const char* flag) {
+	char name[32];
+	const char* value = strchr(flag, '=');
+	size_t length = value != NULL ? (size_t)(value - flag) : strlen(flag);
+	
+	if (length - 5 >= sizeof(name)) usage();
+	memcpy(name, flag + 5, length - 5);
+	name[length - 5] = '\0';
+	
+	if (!setGCOption(name, value != NULL ? value + 1 : NULL)) {
+		fprintf(stderr, "\e[1;31mInvalid option '%s'.\n\e[0m", flag);
+		usage();
+	}
+}
+
 int main(int argc, const char* argv[]) {
 	initVM();
+	configureGC();
+	
+	const char* path = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (strncmp(argv[i], "--gc-", 5) == 0) {
+			parseGCFlag(argv[i]);
+		} else if (path == NULL) {
+			path = argv[i];
+		} else {
+			usage();
+		}
+	}
 	
-	if (argc == 1) {
+	if (path == NULL) {
 		repl();
-	} else if (argc == 2) {
-		runFile(argv[1]);
 	} else {
-		fprintf(stderr, "Usage: olive [path]\n");
-		exit(64);
+		runFile(path);
 	}
 	freeVM(REPLmode);
 	return 0;
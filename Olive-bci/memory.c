@@ -1,15 +1,25 @@
+#include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 #include "compiler.h"
 #include "memory.h"
 #include "vm.h"
 
 #ifdef DEBUG_LOG_GC
-#include <stdio.h>
 #include "debug.h"
 #endif
 
-#define GC_HEAP_GROW_FACTOR 2
+#define GC_COMPACT_THRESHOLD 4 // compact once the bytes freed since the last compaction reach 4x the live heap
+#define GC_SWEEP_STEP 64 // objects swept by each allocation while a lazy sweep is pending
+
+static void sweepObjects(int budget);
 
 void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
 	vm.bytesAllocated += newSize - oldSize;
@@ -19,9 +29,27 @@ void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
 		collectGarbage();
 #endif
 
+		if (vm.sweepPrevious != NULL) {
+			sweepObjects(GC_SWEEP_STEP);
+		}
+
 		if (vm.bytesAllocated > vm.nextGC) {
 			collectGarbage();
 		}
+		
+		if (vm.maxHeap != 0 && vm.bytesAllocated > vm.maxHeap) {
+			// Emergency collection: reclaim everything unreachable before giving up.
+			collectGarbage();
+			finishSweep();
+			if (vm.bytesAllocated > vm.maxHeap) {
+				vm.bytesAllocated -= newSize - oldSize;
+				outOfMemory();
+			}
+		}
+		
+		if (vm.bytesAllocated > vm.gcStats.peakHeap) {
+			vm.gcStats.peakHeap = vm.bytesAllocated;
+		}
 	}
 
 	if(newSize == 0) {
@@ -30,7 +58,10 @@ void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
 	}
 	
 	void* result = realloc(pointer, newSize);
-	if (result == NULL) exit(1);
+	if (result == NULL) {
+		vm.bytesAllocated -= newSize - oldSize;
+		outOfMemory();
+	}
 	return result;
 }
 
@@ -99,6 +130,7 @@ static void blackenObject(Obj* object) {
 		case OBJ_FUNCTION: {
 			ObjFunction* function = (ObjFunction*)object;
 			markObject((Obj*)function->name);
+			markObject((Obj*)function->closure);
 			markArray(function->chunk.constants);
 			break;
 		}
@@ -110,11 +142,39 @@ static void blackenObject(Obj* object) {
 			break;
 		}
 		
+		case OBJ_LIST:
+			markArray(&((ObjList*)object)->items);
+			break;
+		
+		case OBJ_MAP:
+			markTable(&((ObjMap*)object)->table);
+			break;
+		
+		case OBJ_STRING: {
+			ObjString* string = (ObjString*)object;
+			if (IS_VIEW(string)) {
+				// the parent is only marked by settleViews() if it's worth keeping.
+				if (vm.viewCapacity < vm.viewCount + 1) {
+					vm.viewCapacity = GROW_CAPACITY(vm.viewCapacity);
+					vm.viewStack = realloc(vm.viewStack, sizeof(ObjString*) * vm.viewCapacity);
+					
+					if (vm.viewStack == NULL) exit(1);
+				}
+				vm.viewStack[vm.viewCount++] = string;
+				break;
+			}
+			markObject((Obj*)string->left);
+			markObject((Obj*)string->right);
+			break;
+		}
+		
 		case OBJ_UPVALUE:
 			markValue(((ObjUpvalue*)object)->closed);
 			break;
+		case OBJ_FLOAT64_ARRAY:
 		case OBJ_NATIVE:
-		case OBJ_STRING:
+		case OBJ_RANGE:
+		case OBJ_STRING_BUILDER:
 			break;
 	}
 }
@@ -131,14 +191,21 @@ static void freeObject(Obj* object) {
 		case OBJ_CLASS: {
 			ObjClass* c = (ObjClass*)object;
 			freeTable(&c->methods);
+			FREE_ARRAY(ObjClosure*, c->vtable, c->vtableCount);
 			FREE(ObjClass, object);
 			break;
 		}
 		
 		case OBJ_CLOSURE: {
 			ObjClosure* closure = (ObjClosure*)object;
-			FREE_ARRAY(ObjUpvalue*, closure->upvalues, closure->upvalueCount);
-			FREE(ObjClosure, object);
+			reallocate(object, sizeof(ObjClosure) + sizeof(ObjUpvalue*) * closure->upvalueCount, 0);
+			break;
+		}
+		
+		case OBJ_FLOAT64_ARRAY: {
+			ObjFloat64Array* array = (ObjFloat64Array*)object;
+			FREE_ARRAY(double, array->data, array->count);
+			FREE(ObjFloat64Array, object);
 			break;
 		}
 		
@@ -156,17 +223,45 @@ static void freeObject(Obj* object) {
 			break;
 		}
 		
+		case OBJ_LIST: {
+			freeValueArray(&((ObjList*)object)->items);
+			FREE(ObjList, object);
+			break;
+		}
+		
+		case OBJ_MAP: {
+			freeTable(&((ObjMap*)object)->table);
+			FREE(ObjMap, object);
+			break;
+		}
+		
 		case OBJ_NATIVE: {
 			FREE(ObjNative, object);
 			break;
 		}
 		
+		case OBJ_RANGE: {
+			FREE(ObjRange, object);
+			break;
+		}
+		
 		case OBJ_STRING: {
 			ObjString* string = (ObjString*)object;
 			if (string->ownString) {
-				FREE_ARRAY(char, (char*)string->chars, string->length + 1);
+				reallocate(object, sizeof(ObjString) + string->length + 1, 0);
+			} else {
+				if (string->detached) {
+					FREE_ARRAY(char, (char*)string->chars, string->length + 1);
+				}
+				FREE(ObjString, object);
 			}
-			FREE(ObjString, object);
+			break;
+		}
+		
+		case OBJ_STRING_BUILDER: {
+			ObjStringBuilder* builder = (ObjStringBuilder*)object;
+			FREE_ARRAY(char, builder->chars, builder->capacity);
+			FREE(ObjStringBuilder, object);
 			break;
 		}
 		
@@ -193,8 +288,13 @@ static void markRoots() {
 	
 	markTable(&vm.globals);
 	markTable(&vm.globalConstantIndex);
+	markTable(&vm.nativeConstantIndex);
+	markTable(&vm.selectors);
 	markCompilerRoots();
 	markObject((Obj*)vm.initString);
+	for (int i = 0; i <= UINT8_MAX; i++) {
+		markObject((Obj*)vm.charStrings[i]);
+	}
 }
 
 // A black object is any object whose isMarked field is set and that is no longer in the gray stack
@@ -205,10 +305,100 @@ static void traceReferences() {
 	}
 }
 
-static void sweep() {
-	Obj* previous = NULL;
-	Obj* object = vm.objects;
-	while (object != NULL) {
+/* Views met while marking haven't marked their parent. With everything else marked, a view whose parent is otherwise unreached and much longer than the view copies its characters out (malloc directly, there's no collecting in the middle of a collection) and lets the parent go; any other view keeps its parent. */
+static void settleViews() {
+	for (int i = 0; i < vm.viewCount; i++) {
+		ObjString* view = vm.viewStack[i];
+		ObjString* parent = view->left;
+		if (parent->obj.isMarked) continue;
+		
+		if (parent->length / VIEW_DETACH_RATIO >= view->length) {
+			char* chars = malloc(view->length + 1);
+			if (chars != NULL) {
+				memcpy(chars, view->chars, view->length);
+				chars[view->length] = '\0';
+				vm.bytesAllocated += view->length + 1;
+				view->chars = chars;
+				view->left = NULL;
+				view->detached = true;
+				continue;
+			}
+		}
+		
+		markObject((Obj*)parent);
+	}
+	
+	vm.viewCount = 0;
+}
+
+/* The next collection threshold, as tuned by the --gc-* options (see setGCOption()). */
+static size_t nextThreshold() {
+	size_t next = (size_t)(vm.bytesAllocated * vm.heapGrowFactor);
+	if (next < vm.bytesAllocated + vm.minCollectInterval) {
+		next = vm.bytesAllocated + vm.minCollectInterval;
+	}
+	if (vm.maxHeap != 0 && next > vm.maxHeap) {
+		next = vm.maxHeap;
+	}
+	
+	return next;
+}
+
+static void endSweep() {
+	vm.sweepPrevious = NULL;
+	vm.nextGC = nextThreshold();
+	vm.gcStats.bytesFreed += vm.bytesSwept;
+	
+	if (vm.logGC) {
+		fprintf(stderr, "[gc] #%d freed %zu bytes, %zu live, next at %zu, %.3fms paused in total\n", vm.gcStats.collections, vm.bytesSwept, vm.bytesAllocated, vm.nextGC, vm.gcStats.pauseTime * 1000);
+	}
+
+#ifdef GC_COMPACT
+	/* malloc can't tell us how fragmented its arenas are, so the bytes handed back since the last compaction stand in for the holes left behind. The compaction itself waits for a safe point in the interpreter (see compactHeap()). */
+	vm.bytesFreedSinceCompact += vm.bytesSwept;
+	if (vm.bytesFreedSinceCompact > vm.bytesAllocated * GC_COMPACT_THRESHOLD) {
+		vm.compactPending = true;
+	}
+#ifdef DEBUG_STRESS_COMPACT
+	vm.compactPending = true;
+#endif
+#endif
+
+#ifdef DEBUG_LOG_GC
+	printf("-- sweep end\n");
+	printf("   collected %ld bytes, %ld left, next at %ld\n", vm.bytesSwept, vm.bytesAllocated, vm.nextGC);
+#endif
+}
+
+static void freeUnreached(Obj* unreached) {
+	size_t before = vm.bytesAllocated;
+	freeObject(unreached);
+	vm.bytesSwept += before - vm.bytesAllocated;
+}
+
+/* The sweep is lazy: beginSweep() only frees the unreached objects at the head of the list and leaves a cursor behind the first survivor. Every allocation then sweeps GC_SWEEP_STEP more objects through sweepObjects(), so the cost of walking the list is spread over the mutator instead of being paid in one pause. Objects allocated meanwhile are pushed on the list head, in front of the cursor, and are never visited by the pending sweep. */
+static void beginSweep() {
+	vm.bytesSwept = 0;
+	
+	while (vm.objects != NULL && !vm.objects->isMarked) {
+		Obj* unreached = vm.objects;
+		vm.objects = unreached->next;
+		freeUnreached(unreached);
+	}
+	
+	if (vm.objects == NULL) {
+		endSweep();
+		return;
+	}
+	
+	vm.objects->isMarked = false;
+	vm.sweepPrevious = vm.objects;
+}
+
+static void sweepObjects(int budget) {
+	Obj* previous = vm.sweepPrevious;
+	Obj* object = previous->next;
+	while (object != NULL && budget-- > 0) {
 		if (object->isMarked) {
 			object->isMarked = false;
 			previous = object;
@@ -217,36 +407,334 @@ static void sweep() {
 			Obj* unreached = object;
 			
 			object = object->next;
-			if (previous != NULL) {
-				previous->next = object;
-			} else {
-				vm.objects = object;
-			}
+			previous->next = object;
 			
-			freeObject(unreached);
+			freeUnreached(unreached);
 		}
 	}
+	
+	if (object == NULL) {
+		endSweep();
+	} else {
+		vm.sweepPrevious = previous;
+	}
+}
+
+/* Sweep whatever the allocator has not gotten to yet. */
+void finishSweep() {
+	if (vm.sweepPrevious != NULL) {
+		clock_t start = clock();
+		sweepObjects(INT_MAX);
+		vm.gcStats.pauseTime += (double)(clock() - start) / CLOCKS_PER_SEC;
+	}
 }
 
 void collectGarbage() {
+	finishSweep();
+	clock_t start = clock();
+	vm.gcStats.collections++;
+	
 #ifdef DEBUG_LOG_GC
 	printf("--gc begin\n");
-	size_t before = vm.bytesAllocated;
 #endif
 
 	markRoots();
 	traceReferences();
+	settleViews();
+	traceReferences();
 	tableRemoveWhite(&vm.strings);
-	sweep();
+	beginSweep();
 	
-	vm.nextGC = vm.bytesAllocated * GC_HEAP_GROW_FACTOR;
+	if (vm.sweepPrevious != NULL) {
+		// Provisional until the sweep completes; the unswept garbage still counts towards bytesAllocated.
+		vm.nextGC = nextThreshold();
+	}
+	
+	vm.gcStats.pauseTime += (double)(clock() - start) / CLOCKS_PER_SEC;
 
 #ifdef DEBUG_LOG_GC
 	printf("-- gc end\n");
-	printf("   collected %ld bytes (from %ld to %ld) next at %ld", before - vm.bytesAllocated, before, vm.bytesAllocated, vm.nextGC);
 #endif
 }
 
+static size_t objectSize(Obj* object) {
+	switch(object->type) {
+		case OBJ_BOUND_METHOD: return sizeof(ObjBoundMethod);
+		case OBJ_CLASS: return sizeof(ObjClass);
+		case OBJ_CLOSURE: return sizeof(ObjClosure) + sizeof(ObjUpvalue*) * ((ObjClosure*)object)->upvalueCount;
+		case OBJ_FLOAT64_ARRAY: return sizeof(ObjFloat64Array);
+		case OBJ_FUNCTION: return sizeof(ObjFunction);
+		case OBJ_INSTANCE: return sizeof(ObjInstance);
+		case OBJ_LIST: return sizeof(ObjList);
+		case OBJ_MAP: return sizeof(ObjMap);
+		case OBJ_NATIVE: return sizeof(ObjNative);
+		case OBJ_RANGE: return sizeof(ObjRange);
+		case OBJ_STRING: {
+			ObjString* string = (ObjString*)object;
+			return sizeof(ObjString) + (string->ownString ? string->length + 1 : 0);
+		}
+		case OBJ_STRING_BUILDER: return sizeof(ObjStringBuilder);
+		case OBJ_UPVALUE: return sizeof(ObjUpvalue);
+	}
+	
+	return 0;
+}
+
+/* During a compaction every evacuated object is left marked with 'next' holding its new address, while the copies are unmarked. Forwarding an already forwarded reference is therefore a no-op, which matters for the constants array shared by all function chunks. */
+Obj* forwardObject(Obj* object) {
+	if (object == NULL || !object->isMarked) return object;
+	return object->next;
+}
+
+static void forwardValue(Value* value) {
+	if (!IS_OBJ(*value)) return;
+	value->as.obj = forwardObject(value->as.obj);
+}
+
+static void forwardArray(ValueArray* array) {
+	for (int i = 0; i < array->count; i++) {
+		forwardValue(&array->values[i]);
+	}
+}
+
+static void forwardTable(Table* table) {
+	for (int i = 0; i <= table->capacity; i++) {
+		if (table->entries == NULL) return;
+		Entry* entry = &table->entries[i];
+		if (entry->key.type == VAL_OBJ) {
+			entry->key.as.obj = (ObjString*)forwardObject((Obj*)entry->key.as.obj);
+		}
+		forwardValue(&entry->value);
+	}
+}
+
+/* Fix up the references held by 'copy', the evacuated image of 'old'. */
+static void forwardReferences(Obj* old, Obj* copy) {
+	switch(copy->type) {
+		case OBJ_BOUND_METHOD: {
+			ObjBoundMethod* bound = (ObjBoundMethod*)copy;
+			forwardValue(&bound->reciever);
+			bound->method = (ObjClosure*)forwardObject((Obj*)bound->method);
+			break;
+		}
+		
+		case OBJ_CLASS: {
+			ObjClass* c = (ObjClass*)copy;
+			c->name = (ObjString*)forwardObject((Obj*)c->name);
+			forwardTable(&c->methods);
+			forwardValue(&c->initCall);
+			for (int i = 0; i < c->vtableCount; i++) {
+				c->vtable[i] = (ObjClosure*)forwardObject((Obj*)c->vtable[i]);
+			}
+			break;
+		}
+		
+		case OBJ_CLOSURE: {
+			ObjClosure* closure = (ObjClosure*)copy;
+			closure->function = (ObjFunction*)forwardObject((Obj*)closure->function);
+			for (int i = 0; i < closure->upvalueCount; i++) {
+				closure->upvalues[i] = (ObjUpvalue*)forwardObject((Obj*)closure->upvalues[i]);
+			}
+			break;
+		}
+		
+		case OBJ_FUNCTION: {
+			ObjFunction* function = (ObjFunction*)copy;
+			function->name = (ObjString*)forwardObject((Obj*)function->name);
+			function->closure = (ObjClosure*)forwardObject((Obj*)function->closure);
+			forwardArray(function->chunk.constants);
+			break;
+		}
+		
+		case OBJ_INSTANCE: {
+			ObjInstance* instance = (ObjInstance*)copy;
+			instance->c = (ObjClass*)forwardObject((Obj*)instance->c);
+			forwardTable(&instance->fields);
+			break;
+		}
+		
+		case OBJ_LIST:
+			forwardArray(&((ObjList*)copy)->items);
+			break;
+		
+		case OBJ_MAP:
+			forwardTable(&((ObjMap*)copy)->table);
+			break;
+		
+		case OBJ_UPVALUE: {
+			ObjUpvalue* upvalue = (ObjUpvalue*)copy;
+			// A closed upvalue points at its own 'closed' field, an open one into the VM stack which stays put.
+			if (upvalue->location == &((ObjUpvalue*)old)->closed) {
+				upvalue->location = &upvalue->closed;
+			}
+			forwardValue(&upvalue->closed);
+			upvalue->next = (ObjUpvalue*)forwardObject((Obj*)upvalue->next);
+			break;
+		}
+		
+		case OBJ_STRING: {
+			ObjString* string = (ObjString*)copy;
+			if (string->ownString) {
+				string->chars = string->inlineChars;
+			} else if (IS_VIEW(string) && string->left->ownString) {
+				// 'left' is still the old parent here, keep the same offset into its copy.
+				ObjString* parent = string->left;
+				string->chars = ((ObjString*)forwardObject((Obj*)parent))->inlineChars + (string->chars - parent->inlineChars);
+			}
+			string->left = (ObjString*)forwardObject((Obj*)string->left);
+			string->right = (ObjString*)forwardObject((Obj*)string->right);
+			break;
+		}
+		
+		case OBJ_FLOAT64_ARRAY:
+		case OBJ_NATIVE:
+		case OBJ_RANGE:
+		case OBJ_STRING_BUILDER:
+			break;
+	}
+}
+
+static void forwardRoots() {
+	for (Value* slot = vm.stack.stack; slot < vm.stackTop; slot++) {
+		forwardValue(slot);
+	}
+	
+	for (int i = 0; i < vm.frameCount; i++) {
+		vm.frames[i].closure = (ObjClosure*)forwardObject((Obj*)vm.frames[i].closure);
+	}
+	
+	vm.openUpvalues = (ObjUpvalue*)forwardObject((Obj*)vm.openUpvalues);
+	
+	forwardTable(&vm.globals);
+	forwardTable(&vm.strings);
+	forwardTable(&vm.globalConstantIndex);
+	forwardTable(&vm.nativeConstantIndex);
+	forwardTable(&vm.selectors);
+	forwardCompilerRoots();
+	vm.initString = (ObjString*)forwardObject((Obj*)vm.initString);
+	for (int i = 0; i <= UINT8_MAX; i++) {
+		vm.charStrings[i] = (ObjString*)forwardObject((Obj*)vm.charStrings[i]);
+	}
+}
+
+/* Evacuate every live object into freshly allocated memory, in list order, and release the old blocks so the allocator can coalesce them. 
+Nothing in C may hold an object pointer across this call, so the interpreter only calls it at safe points where all references live in the roots (see run()). The objects' own buffers (chunks, tables, string characters) are not moved. */
+void compactHeap() {
+	// Forwarding relies on every surviving object being unmarked.
+	finishSweep();
+	vm.compactPending = false;
+	vm.bytesFreedSinceCompact = 0;
+	
+	int count = 0;
+	for (Obj* object = vm.objects; object != NULL; object = object->next) {
+		count++;
+	}
+	if (count == 0) return;
+	
+#ifdef DEBUG_LOG_GC
+	printf("-- compact begin (%d objects)\n", count);
+#endif
+	
+	Obj** olds = malloc(sizeof(Obj*) * count);
+	Obj** copies = malloc(sizeof(Obj*) * count);
+	if (olds == NULL || copies == NULL) {
+		// Not worth failing over. The heap is simply left as it is.
+		free(olds);
+		free(copies);
+		return;
+	}
+	
+	int i = 0;
+	for (Obj* object = vm.objects; object != NULL; object = object->next) {
+		olds[i] = object;
+		copies[i] = malloc(objectSize(object));
+		if (copies[i] == NULL) {
+			while (i >= 0) free(copies[i--]);
+			free(olds);
+			free(copies);
+			return;
+		}
+		i++;
+	}
+	
+	for (i = 0; i < count; i++) {
+		memcpy(copies[i], olds[i], objectSize(olds[i]));
+		copies[i]->isMarked = false;
+		copies[i]->next = i + 1 < count ? copies[i + 1] : NULL;
+		
+		olds[i]->isMarked = true;
+		olds[i]->next = copies[i];
+	}
+	vm.objects = copies[0];
+	
+	for (i = 0; i < count; i++) {
+		forwardReferences(olds[i], copies[i]);
+	}
+	forwardRoots();
+	
+	for (i = 0; i < count; i++) {
+		free(olds[i]);
+	}
+	free(olds);
+	free(copies);
+	
+#ifdef __GLIBC__
+	malloc_trim(0);
+#endif
+
+#ifdef DEBUG_LOG_GC
+	printf("-- compact end\n");
+#endif
+}
+
+static bool parseSize(const char* text, size_t* size) {
+	char* end;
+	double value = strtod(text, &end);
+	if (end == text || value < 0) return false;
+	
+	switch(*end) {
+		case 'k': case 'K': value *= 1024; end++; break;
+		case 'm': case 'M': value *= 1024 * 1024; end++; break;
+		case 'g': case 'G': value *= 1024 * 1024 * 1024; end++; break;
+	}
+	
+	if (*end != '\0') return false;
+	*size = (size_t)value;
+	return true;
+}
+
+/* Apply a GC tuning option by name, from the command line or the environment. Sizes take an optional k/m/g suffix. Returns false on an unknown option or a malformed value.
+	'initial' -> heap size that triggers the first collection.
+	'grow' -> factor the live heap is multiplied by to get the next threshold.
+	'max' -> hard limit on the heap size. Going over it raises an out-of-memory runtime error.
+	'interval' -> minimum number of bytes allocated between two collections.
+	'log' -> print a line to stderr after every collection.
+*/
+bool setGCOption(const char* name, const char* value) {
+	if (strcmp(name, "log") == 0) {
+		vm.logGC = value == NULL || strcmp(value, "0") != 0;
+		return true;
+	}
+	
+	if (value == NULL) return false;
+	
+	if (strcmp(name, "initial") == 0) {
+		return parseSize(value, &vm.nextGC);
+	} else if (strcmp(name, "max") == 0) {
+		return parseSize(value, &vm.maxHeap);
+	} else if (strcmp(name, "interval") == 0) {
+		return parseSize(value, &vm.minCollectInterval);
+	} else if (strcmp(name, "grow") == 0) {
+		char* end;
+		double factor = strtod(value, &end);
+		if (end == value || *end != '\0' || factor < 1) return false;
+		vm.heapGrowFactor = factor;
+		return true;
+	}
+	
+	return false;
+}
+
 void freeObjects() {
 	Obj* object = vm.objects;
 	while(object != NULL) {
@@ -256,4 +744,5 @@ void freeObjects() {
 	}
 	
 	free(vm.grayStack);
+	free(vm.viewStack);
 }
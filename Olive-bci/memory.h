@@ -13,7 +13,7 @@
 	((capacity) < 8 ? 8 : (capacity)*2)
 
 #define GROW_STACK_CAPACITY(capacity) \
-	((capacity) < 256 ? 256 : (256)*2)
+	((capacity) < 256 ? 256 : (capacity)*2)
 
 #define GROW_ARRAY(type, pointer, oldCount, newCount) \
 	(type*)reallocate(pointer, sizeof(type)*(oldCount), sizeof(type)*(newCount))
@@ -25,6 +25,10 @@ void* reallocate(void* pointer, size_t oldSize, size_t newSize);
 void markObject(Obj* object);
 void markValue(Value value);
 void collectGarbage();
+bool setGCOption(const char* name, const char* value);
+void finishSweep();
+Obj* forwardObject(Obj* object);
+void compactHeap();
 void freeObjects();
 
 #endif
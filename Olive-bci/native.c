@@ -0,0 +1,665 @@
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "float64.h"
+#include "memory.h"
+#include "native.h"
+#include "object.h"
+#include "value.h"
+#include "vm.h"
+
+/* Native functions. A native reports an error by calling runtimeError() and returning NULL_VAL. */
+
+static Value clockNative(int argCount, Value* args) {
+	if (argCount != 0) {
+		runtimeError("\e[1;31mError: 'clock' function call expected 0 argument(s). Initialized with %d argument(s) instead, ", argCount);
+		return NULL_VAL;
+	}
+	
+	return NUMBER_VAL((double)clock() / CLOCKS_PER_SEC);
+}
+
+/* set a field on an instance sitting at the top of the VM stack. */
+static void setField(ObjInstance* instance, const char* name, Value value) {
+	push(OBJ_VAL(allocateString(false, name, (int)strlen(name))));
+	tableSet(&instance->fields, &OBJ_KEY(AS_STRING(vm.stackTop[-1])), value);
+	pop(1);
+}
+
+static Value gcStatsNative(int argCount, Value* args) {
+	if (argCount != 0) {
+		runtimeError("\e[1;31mError: 'gc_stats' function call expected 0 argument(s). Initialized with %d argument(s) instead, ", argCount);
+		return NULL_VAL;
+	}
+	
+	push(OBJ_VAL(newClass(allocateString(false, "gc_stats", 8))));
+	ObjInstance* stats = newInstance(AS_CLASS(vm.stackTop[-1]));
+	pop(1);
+	push(OBJ_VAL(stats));
+	
+	setField(stats, "collections", INT_VAL((int64_t)vm.gcStats.collections));
+	setField(stats, "pause_time", NUMBER_VAL(vm.gcStats.pauseTime));
+	setField(stats, "bytes_freed", INT_VAL((int64_t)vm.gcStats.bytesFreed));
+	setField(stats, "peak_heap", INT_VAL((int64_t)vm.gcStats.peakHeap));
+	setField(stats, "heap", INT_VAL((int64_t)vm.bytesAllocated));
+	
+	pop(1);
+	return OBJ_VAL(stats);
+}
+
+static Value gcCollectNative(int argCount, Value* args) {
+	if (argCount != 0) {
+		runtimeError("\e[1;31mError: 'gc_collect' function call expected 0 argument(s). Initialized with %d argument(s) instead, ", argCount);
+		return NULL_VAL;
+	}
+	
+	size_t before = vm.bytesAllocated;
+	collectGarbage();
+	finishSweep();
+	return INT_VAL((int64_t)before - (int64_t)vm.bytesAllocated);
+}
+
+/* make room for 'length' more characters in a string builder. */
+static void reserveBuilder(ObjStringBuilder* builder, int length) {
+	if (builder->capacity >= builder->length + length) return;
+	
+	int oldCapacity = builder->capacity;
+	int capacity = oldCapacity;
+	while (capacity < builder->length + length) {
+		capacity = GROW_CAPACITY(capacity);
+	}
+	builder->chars = GROW_ARRAY(char, builder->chars, oldCapacity, capacity);
+	builder->capacity = capacity;
+}
+
+/* append a value with the same text '+' gives it. */
+static bool appendValue(ObjStringBuilder* builder, Value value) {
+	if (IS_STRING(value)) {
+		ObjString* string = AS_STRING(value);
+		reserveBuilder(builder, string->length);
+		copyStringChars(string, builder->chars + builder->length);
+		builder->length += string->length;
+		return true;
+	}
+	
+	char buffer[VALUE_TEXT_MAX];
+	int length = valueText(value, buffer);
+	if (length < 0) return false;
+	
+	reserveBuilder(builder, length);
+	memcpy(builder->chars + builder->length, buffer, length);
+	builder->length += length;
+	return true;
+}
+
+static Value stringBuilderNative(int argCount, Value* args) {
+	if (argCount != 0) {
+		runtimeError("\e[1;31mError: 'StringBuilder' function call expected 0 argument(s). Initialized with %d argument(s) instead, ", argCount);
+		return NULL_VAL;
+	}
+	
+	return OBJ_VAL(newStringBuilder());
+}
+
+/* append(list, values...) adds the values to the end of the list, append(builder, values...) adds their text to the builder. */
+static Value appendNative(int argCount, Value* args) {
+	if (argCount >= 1 && IS_LIST(args[0])) {
+		ObjList* list = AS_LIST(args[0]);
+		for (int i = 1; i < argCount; i++) {
+			writeValueArray(&list->items, args[i]);
+		}
+		return args[0];
+	}
+	
+	if (argCount < 1 || !IS_STRING_BUILDER(args[0])) {
+		runtimeError("\e[1;31mError: 'append' expects a list or a string builder as its first argument, ");
+		return NULL_VAL;
+	}
+	
+	ObjStringBuilder* builder = AS_STRING_BUILDER(args[0]);
+	for (int i = 1; i < argCount; i++) {
+		if (!appendValue(builder, args[i])) {
+			runtimeError("\e[1;31mError: Invalid operands for string conversion. ");
+			return NULL_VAL;
+		}
+	}
+	
+	return args[0];
+}
+
+/* append_sep(builder, separator, values...). The separator goes before every value, except at the very start of the builder. */
+static Value appendSepNative(int argCount, Value* args) {
+	if (argCount < 2 || !IS_STRING_BUILDER(args[0]) || !IS_STRING(args[1])) {
+		runtimeError("\e[1;31mError: 'append_sep' expects a string builder and a separator string as its first arguments, ");
+		return NULL_VAL;
+	}
+	
+	ObjStringBuilder* builder = AS_STRING_BUILDER(args[0]);
+	for (int i = 2; i < argCount; i++) {
+		if (builder->length > 0) {
+			appendValue(builder, args[1]);
+		}
+		
+		if (!appendValue(builder, args[i])) {
+			runtimeError("\e[1;31mError: Invalid operands for string conversion. ");
+			return NULL_VAL;
+		}
+	}
+	
+	return args[0];
+}
+
+/* copy the contents of a builder into a new string. The builder keeps its contents and can go on growing. */
+static Value buildNative(int argCount, Value* args) {
+	if (argCount != 1 || !IS_STRING_BUILDER(args[0])) {
+		runtimeError("\e[1;31mError: 'build' expects a single string builder argument, ");
+		return NULL_VAL;
+	}
+	
+	ObjStringBuilder* builder = AS_STRING_BUILDER(args[0]);
+	return OBJ_VAL(copyString(builder->length > 0 ? builder->chars : "", builder->length));
+}
+
+/* a number argument as an int, truncated toward zero. False for NaN, infinities and numbers past the int range, which have no int to convert to. */
+static bool intArgument(Value value, int* result) {
+	double number = trunc(AS_NUMBER(value));
+	if (!isfinite(number) || number < INT_MIN || number > INT_MAX) return false;
+	*result = (int)number;
+	return true;
+}
+
+/* slice(string, start[, end]): the characters from start up to, not including, end (the end of the string by default). Negative indices count from the end. Long slices share the characters of the string instead of copying them. */
+static Value sliceNative(int argCount, Value* args) {
+	if ((argCount != 2 && argCount != 3) || !IS_STRING(args[0]) || !IS_NUMBER(args[1]) || (argCount == 3 && !IS_NUMBER(args[2]))) {
+		runtimeError("\e[1;31mError: 'slice' expects a string, a start index and an optional end index, ");
+		return NULL_VAL;
+	}
+	
+	int start;
+	int end = INT_MAX;
+	if (!intArgument(args[1], &start) || (argCount == 3 && !intArgument(args[2], &end))) {
+		runtimeError("\e[1;31mError: 'slice' indices must be finite numbers within the int range, ");
+		return NULL_VAL;
+	}
+	
+	ObjString* string = flattenString(AS_STRING(args[0]));
+	args[0] = OBJ_VAL(string);
+	
+	int length = string->length;
+	if (argCount == 2) end = length;
+	if (start < 0) start += length;
+	if (end < 0) end += length;
+	if (start < 0) start = 0;
+	if (end > length) end = length;
+	if (end < start) end = start;
+	
+	if (start == 0 && end == length) {
+		return args[0];
+	}
+	
+	if (end - start < VIEW_MIN_LENGTH) {
+		return OBJ_VAL(copyString(string->chars + start, end - start));
+	}
+	return OBJ_VAL(newView(string, start, end - start));
+}
+
+static Value lenNative(int argCount, Value* args) {
+	if (argCount == 1 && IS_LIST(args[0])) {
+		return INT_VAL(AS_LIST(args[0])->items.count);
+	}
+	
+	if (argCount == 1 && IS_MAP(args[0])) {
+		return INT_VAL(AS_MAP(args[0])->table.count);
+	}
+	
+	if (argCount == 1 && IS_FLOAT64_ARRAY(args[0])) {
+		return INT_VAL(AS_FLOAT64_ARRAY(args[0])->count);
+	}
+	
+	if (argCount == 1 && IS_RANGE(args[0])) {
+		// a range of doubles can be longer than any integer.
+		double length = rangeLength(AS_RANGE(args[0]));
+		return length < 0x1p63 ? INT_VAL((int64_t)length) : NUMBER_VAL(length);
+	}
+	
+	if (argCount != 1 || !IS_STRING(args[0])) {
+		runtimeError("\e[1;31mError: 'len' expects a single string, list, map, Float64Array or range argument, ");
+		return NULL_VAL;
+	}
+	
+	return INT_VAL(AS_STRING(args[0])->length);
+}
+
+/* pop(list): remove the last element of the list and return it. */
+static Value popNative(int argCount, Value* args) {
+	if (argCount != 1 || !IS_LIST(args[0])) {
+		runtimeError("\e[1;31mError: 'pop' expects a single list argument, ");
+		return NULL_VAL;
+	}
+	
+	ValueArray* items = &AS_LIST(args[0])->items;
+	if (items->count == 0) {
+		runtimeError("\e[1;31mError: Attempt to pop from an empty list, ");
+		return NULL_VAL;
+	}
+	
+	return items->values[--items->count];
+}
+
+/* insert(list, index, value): insert the value before the element at index. An index equal to the length appends, negative indices count from the end. */
+static Value insertNative(int argCount, Value* args) {
+	if (argCount != 3 || !IS_LIST(args[0]) || !IS_NUMBER(args[1])) {
+		runtimeError("\e[1;31mError: 'insert' expects a list, an index and a value, ");
+		return NULL_VAL;
+	}
+	
+	ValueArray* items = &AS_LIST(args[0])->items;
+	int count = items->count;
+	int index;
+	if (!intArgument(args[1], &index) || AS_NUMBER(args[1]) != index) {
+		runtimeError("\e[1;31mError: 'insert' index must be an integer, ");
+		return NULL_VAL;
+	}
+	if (index < 0) index += count;
+	if (index < 0 || index > count) {
+		runtimeError("\e[1;31mError: 'insert' index %g out of range for a list of %d element(s), ", AS_NUMBER(args[1]), count);
+		return NULL_VAL;
+	}
+	
+	// growing allocates, so the arguments are read first.
+	Value list = args[0];
+	Value value = args[2];
+	writeValueArray(items, NULL_VAL);
+	memmove(&items->values[index + 1], &items->values[index], sizeof(Value) * (count - index));
+	items->values[index] = value;
+	return list;
+}
+
+/* the map in args[0] of a map native and the table key for args[1], reporting an error for 'name' and returning NULL if they aren't. The map is read before making the key allocates. */
+static ObjMap* mapKeyArgument(const char* name, int argCount, Value* args, Key* key) {
+	if (argCount != 2 || !IS_MAP(args[0])) {
+		runtimeError("\e[1;31mError: '%s' expects a map and a key, ", name);
+		return NULL;
+	}
+	
+	ObjMap* map = AS_MAP(args[0]);
+	if (!valueToKey(&args[1], key)) {
+		runtimeError("\e[1;31mError: Map keys must be numbers, strings or booleans, ");
+		return NULL;
+	}
+	return map;
+}
+
+/* has(map, key): whether the map holds the key. */
+static Value hasNative(int argCount, Value* args) {
+	Key key;
+	ObjMap* map = mapKeyArgument("has", argCount, args, &key);
+	if (map == NULL) return NULL_VAL;
+	
+	Value value;
+	return BOOL_VAL(tableGet(&map->table, &key, &value));
+}
+
+/* delete(map, key): remove the key from the map. Returns whether it was there. */
+static Value deleteNative(int argCount, Value* args) {
+	Key key;
+	ObjMap* map = mapKeyArgument("delete", argCount, args, &key);
+	if (map == NULL) return NULL_VAL;
+	
+	return BOOL_VAL(tableDelete(&map->table, &key));
+}
+
+/* keys(map): a new list of the map's keys, in no particular order. */
+static Value keysNative(int argCount, Value* args) {
+	if (argCount != 1 || !IS_MAP(args[0])) {
+		runtimeError("\e[1;31mError: 'keys' expects a single map argument, ");
+		return NULL_VAL;
+	}
+	
+	// read before anything is allocated.
+	Table* table = &AS_MAP(args[0])->table;
+	ObjList* list = newList();
+	push(OBJ_VAL(list));
+	for (int i = 0; i <= table->capacity; i++) {
+		Entry* entry = &table->entries[i];
+		if (IS_NULL(entry->key)) continue;
+		
+		writeValueArray(&list->items, keyToValue(&entry->key));
+	}
+	pop(1);
+	return OBJ_VAL(list);
+}
+
+/* range(end), range(start, end) or range(start, end, step): the numbers from start (0 by default) up to but excluding end, step (1 by default) apart. */
+static Value rangeNative(int argCount, Value* args) {
+	bool valid = argCount >= 1 && argCount <= 3;
+	for (int i = 0; valid && i < argCount; i++) {
+		valid = IS_NUMBER(args[i]);
+	}
+	if (!valid) {
+		runtimeError("\e[1;31mError: 'range' expects 1 to 3 numbers, ");
+		return NULL_VAL;
+	}
+	
+	Value start = argCount == 1 ? INT_VAL(0) : args[0];
+	Value end = argCount == 1 ? args[0] : args[1];
+	Value step = argCount == 3 ? args[2] : INT_VAL(1);
+	if (AS_NUMBER(step) == 0) {
+		runtimeError("\e[1;31mError: 'range' step can't be 0, ");
+		return NULL_VAL;
+	}
+	return OBJ_VAL(newRange(start, end, step));
+}
+
+/* Float64Array(length) is zero-filled, Float64Array(list) copies a list of numbers. */
+static Value float64ArrayNative(int argCount, Value* args) {
+	if (argCount == 1 && IS_NUMBER(args[0]) && AS_NUMBER(args[0]) >= 0 && AS_NUMBER(args[0]) <= INT32_MAX / sizeof(double)) {
+		return OBJ_VAL(newFloat64Array((int)AS_NUMBER(args[0])));
+	}
+	
+	if (argCount != 1 || !IS_LIST(args[0])) {
+		runtimeError("\e[1;31mError: 'Float64Array' expects a length or a list of numbers, ");
+		return NULL_VAL;
+	}
+	
+	ValueArray* items = &AS_LIST(args[0])->items;
+	for (int i = 0; i < items->count; i++) {
+		if (!IS_NUMBER(items->values[i])) {
+			runtimeError("\e[1;31mError: 'Float64Array' expects a list of numbers, element %d isn't one, ", i);
+			return NULL_VAL;
+		}
+	}
+	
+	ObjFloat64Array* array = newFloat64Array(items->count);
+	for (int i = 0; i < items->count; i++) {
+		array->data[i] = AS_NUMBER(items->values[i]);
+	}
+	return OBJ_VAL(array);
+}
+
+/* check the arguments of a bulk native: 'arrays' Float64Arrays of the same length, then 'numbers' numbers. */
+static bool float64Arguments(const char* name, int argCount, Value* args, int arrays, int numbers) {
+	bool valid = argCount == arrays + numbers;
+	for (int i = 0; valid && i < arrays; i++) {
+		valid = IS_FLOAT64_ARRAY(args[i]) && AS_FLOAT64_ARRAY(args[i])->count == AS_FLOAT64_ARRAY(args[0])->count;
+	}
+	for (int i = arrays; valid && i < argCount; i++) {
+		valid = IS_NUMBER(args[i]);
+	}
+	
+	if (!valid) {
+		runtimeError("\e[1;31mError: '%s' expects %d Float64Array(s) of the same length%s, ", name, arrays, numbers > 0 ? " and a number" : "");
+	}
+	return valid;
+}
+
+static Value sumNative(int argCount, Value* args) {
+	if (!float64Arguments("sum", argCount, args, 1, 0)) return NULL_VAL;
+	
+	ObjFloat64Array* array = AS_FLOAT64_ARRAY(args[0]);
+	return NUMBER_VAL(float64Sum(array->data, array->count));
+}
+
+static Value dotNative(int argCount, Value* args) {
+	if (!float64Arguments("dot", argCount, args, 2, 0)) return NULL_VAL;
+	
+	ObjFloat64Array* a = AS_FLOAT64_ARRAY(args[0]);
+	return NUMBER_VAL(float64Dot(a->data, AS_FLOAT64_ARRAY(args[1])->data, a->count));
+}
+
+/* The bulk natives below work in place and return the array they changed. */
+
+static Value scaleNative(int argCount, Value* args) {
+	if (!float64Arguments("scale", argCount, args, 1, 1)) return NULL_VAL;
+	
+	ObjFloat64Array* array = AS_FLOAT64_ARRAY(args[0]);
+	float64Scale(array->data, AS_NUMBER(args[1]), array->count);
+	return args[0];
+}
+
+/* add(a, b) adds b to a element-wise, add(a, x) adds the number x to every element. */
+static Value addNative(int argCount, Value* args) {
+	if (argCount == 2 && IS_NUMBER(args[1])) {
+		if (!float64Arguments("add", argCount, args, 1, 1)) return NULL_VAL;
+		
+		ObjFloat64Array* array = AS_FLOAT64_ARRAY(args[0]);
+		float64AddScalar(array->data, AS_NUMBER(args[1]), array->count);
+		return args[0];
+	}
+	
+	if (!float64Arguments("add", argCount, args, 2, 0)) return NULL_VAL;
+	
+	ObjFloat64Array* a = AS_FLOAT64_ARRAY(args[0]);
+	float64Add(a->data, AS_FLOAT64_ARRAY(args[1])->data, a->count);
+	return args[0];
+}
+
+static Value prefixSumNative(int argCount, Value* args) {
+	if (!float64Arguments("prefix_sum", argCount, args, 1, 0)) return NULL_VAL;
+	
+	ObjFloat64Array* array = AS_FLOAT64_ARRAY(args[0]);
+	float64PrefixSum(array->data, array->count);
+	return args[0];
+}
+
+static Value sortNative(int argCount, Value* args) {
+	if (!float64Arguments("sort", argCount, args, 1, 0)) return NULL_VAL;
+	
+	ObjFloat64Array* array = AS_FLOAT64_ARRAY(args[0]);
+	float64Sort(array->data, array->count);
+	return args[0];
+}
+
+/* Name and arity of each math native, indexed by MathFunction. */
+static const struct {
+	const char* name;
+	int arity;
+} mathFunctions[] = {
+	[MATH_SQRT] = {"sqrt", 1},
+	[MATH_FLOOR] = {"floor", 1},
+	[MATH_CEIL] = {"ceil", 1},
+	[MATH_ABS] = {"abs", 1},
+	[MATH_SIN] = {"sin", 1},
+	[MATH_COS] = {"cos", 1},
+	[MATH_TAN] = {"tan", 1},
+	[MATH_EXP] = {"exp", 1},
+	[MATH_LOG] = {"log", 1},
+	[MATH_POW] = {"pow", 2},
+	[MATH_ATAN2] = {"atan2", 2},
+	[MATH_MIN] = {"min", 2},
+	[MATH_MAX] = {"max", 2},
+};
+
+/* The math function named by an identifier, or -1. */
+int mathFunction(const char* name, int length) {
+	for (int i = 0; i < MATH_FUNCTION_COUNT; i++) {
+		if ((int)strlen(mathFunctions[i].name) == length && memcmp(mathFunctions[i].name, name, length) == 0) return i;
+	}
+	return -1;
+}
+
+const char* mathFunctionName(MathFunction function) {
+	return mathFunctions[function].name;
+}
+
+/* base ** exponent for integers, false if it doesn't fit in 64 bits. */
+static bool integerPower(int64_t base, int64_t exponent, int64_t* result) {
+	*result = 1;
+	while (exponent > 0) {
+		if ((exponent & 1) && __builtin_mul_overflow(*result, base, result)) return false;
+		exponent >>= 1;
+		if (exponent > 0 && __builtin_mul_overflow(base, base, &base)) return false;
+	}
+	return true;
+}
+
+/* A math function of numbers. Integers stay integers through floor, ceil, abs, min, max and pow with a non-negative exponent, unless the result overflows. */
+static Value mathNumbers(MathFunction function, Value* args) {
+	Value a = args[0];
+	switch (function) {
+		case MATH_SQRT: return NUMBER_VAL(sqrt(AS_NUMBER(a)));
+		case MATH_FLOOR: return IS_INT(a) ? a : NUMBER_VAL(floor(AS_DOUBLE(a)));
+		case MATH_CEIL: return IS_INT(a) ? a : NUMBER_VAL(ceil(AS_DOUBLE(a)));
+		case MATH_ABS:
+			if (IS_INT(a) && AS_INT(a) != INT64_MIN) return AS_INT(a) < 0 ? INT_VAL(-AS_INT(a)) : a;
+			return NUMBER_VAL(fabs(AS_NUMBER(a)));
+		case MATH_SIN: return NUMBER_VAL(sin(AS_NUMBER(a)));
+		case MATH_COS: return NUMBER_VAL(cos(AS_NUMBER(a)));
+		case MATH_TAN: return NUMBER_VAL(tan(AS_NUMBER(a)));
+		case MATH_EXP: return NUMBER_VAL(exp(AS_NUMBER(a)));
+		case MATH_LOG: return NUMBER_VAL(log(AS_NUMBER(a)));
+		default:
+			break;
+	}
+	
+	Value b = args[1];
+	switch (function) {
+		case MATH_POW: {
+			int64_t result;
+			if (IS_INT(a) && IS_INT(b) && AS_INT(b) >= 0 && integerPower(AS_INT(a), AS_INT(b), &result)) {
+				return INT_VAL(result);
+			}
+			return NUMBER_VAL(pow(AS_NUMBER(a), AS_NUMBER(b)));
+		}
+		case MATH_ATAN2: return NUMBER_VAL(atan2(AS_NUMBER(a), AS_NUMBER(b)));
+		// either argument, as it is, and NaN if one is NaN.
+		case MATH_MIN:
+			if (IS_INT(a) && IS_INT(b)) return AS_INT(b) < AS_INT(a) ? b : a;
+			if (isnan(AS_NUMBER(b))) return b;
+			return AS_NUMBER(b) < AS_NUMBER(a) ? b : a;
+		case MATH_MAX:
+			if (IS_INT(a) && IS_INT(b)) return AS_INT(b) > AS_INT(a) ? b : a;
+			if (isnan(AS_NUMBER(b))) return b;
+			return AS_NUMBER(b) > AS_NUMBER(a) ? b : a;
+		default:
+			return NULL_VAL;
+	}
+}
+
+/* The bulk form of a math function: min(a) and max(a) reduce a Float64Array, the others work on it in place, element-wise, with the number as the second argument of pow, atan2, min and max, and return it. */
+static Value mathArray(MathFunction function, int argCount, Value* args) {
+	const char* name = mathFunctions[function].name;
+	ObjFloat64Array* array = AS_FLOAT64_ARRAY(args[0]);
+	
+	if ((function == MATH_MIN || function == MATH_MAX) && argCount == 1) {
+		if (array->count == 0) {
+			runtimeError("\e[1;31mError: '%s' of an empty Float64Array, ", name);
+			return NULL_VAL;
+		}
+		return NUMBER_VAL(function == MATH_MIN ? float64Min(array->data, array->count) : float64Max(array->data, array->count));
+	}
+	
+	if (!float64Arguments(name, argCount, args, 1, mathFunctions[function].arity - 1)) return NULL_VAL;
+	
+	double* data = array->data;
+	int count = array->count;
+	switch (function) {
+		case MATH_SQRT: float64Sqrt(data, count); break;
+		case MATH_FLOOR: float64Floor(data, count); break;
+		case MATH_CEIL: float64Ceil(data, count); break;
+		case MATH_ABS: float64Abs(data, count); break;
+		case MATH_SIN: float64Map(data, sin, count); break;
+		case MATH_COS: float64Map(data, cos, count); break;
+		case MATH_TAN: float64Map(data, tan, count); break;
+		case MATH_EXP: float64Map(data, exp, count); break;
+		case MATH_LOG: float64Map(data, log, count); break;
+		case MATH_POW: float64MapScalar(data, pow, AS_NUMBER(args[1]), count); break;
+		case MATH_ATAN2: float64MapScalar(data, atan2, AS_NUMBER(args[1]), count); break;
+		case MATH_MIN: float64MinScalar(data, AS_NUMBER(args[1]), count); break;
+		case MATH_MAX: float64MaxScalar(data, AS_NUMBER(args[1]), count); break;
+		default: break;
+	}
+	return args[0];
+}
+
+/* Call a math native, the same whether through its global or OP_MATH. */
+Value mathNative(MathFunction function, int argCount, Value* args) {
+	int arity = mathFunctions[function].arity;
+	if (argCount == arity && IS_NUMBER(args[0]) && (arity == 1 || IS_NUMBER(args[1]))) {
+		return mathNumbers(function, args);
+	}
+	
+	if (argCount >= 1 && IS_FLOAT64_ARRAY(args[0])) {
+		return mathArray(function, argCount, args);
+	}
+	
+	runtimeError("\e[1;31mError: '%s' expects %s or a Float64Array, ", mathFunctions[function].name, arity == 1 ? "a number" : "two numbers");
+	return NULL_VAL;
+}
+
+#define MATH_NATIVE(function, name) \
+	static Value name##Native(int argCount, Value* args) { \
+		return mathNative(function, argCount, args); \
+	}
+
+MATH_NATIVE(MATH_SQRT, sqrt)
+MATH_NATIVE(MATH_FLOOR, floor)
+MATH_NATIVE(MATH_CEIL, ceil)
+MATH_NATIVE(MATH_ABS, abs)
+MATH_NATIVE(MATH_SIN, sin)
+MATH_NATIVE(MATH_COS, cos)
+MATH_NATIVE(MATH_TAN, tan)
+MATH_NATIVE(MATH_EXP, exp)
+MATH_NATIVE(MATH_LOG, log)
+MATH_NATIVE(MATH_POW, pow)
+MATH_NATIVE(MATH_ATAN2, atan2)
+MATH_NATIVE(MATH_MIN, min)
+MATH_NATIVE(MATH_MAX, max)
+
+#undef MATH_NATIVE
+
+static void defineNative(const char* name, NativeFunction function) {
+	push(OBJ_VAL(allocateString(false, name, (int)strlen(name))));
+	push(OBJ_VAL(newNative(function)));
+	tableSet(&vm.globals, &OBJ_KEY(AS_STRING(vm.stack.stack[0])), vm.stack.stack[1]);
+	pop(2);
+	vm.nativeIdentifiers[vm.nativeIdentifierCount++] = name;
+}
+
+void initNatives() {
+	vm.nativeIdentifierCount = 0;
+	
+	defineNative("clock", clockNative);
+	defineNative("gc_stats", gcStatsNative);
+	defineNative("gc_collect", gcCollectNative);
+	defineNative("StringBuilder", stringBuilderNative);
+	defineNative("append", appendNative);
+	defineNative("append_sep", appendSepNative);
+	defineNative("build", buildNative);
+	defineNative("slice", sliceNative);
+	defineNative("len", lenNative);
+	defineNative("pop", popNative);
+	defineNative("insert", insertNative);
+	defineNative("has", hasNative);
+	defineNative("delete", deleteNative);
+	defineNative("keys", keysNative);
+	defineNative("Float64Array", float64ArrayNative);
+	defineNative("sum", sumNative);
+	defineNative("dot", dotNative);
+	defineNative("scale", scaleNative);
+	defineNative("add", addNative);
+	defineNative("prefix_sum", prefixSumNative);
+	defineNative("sort", sortNative);
+	defineNative("range", rangeNative);
+	
+	NativeFunction mathNatives[] = {
+		[MATH_SQRT] = sqrtNative,
+		[MATH_FLOOR] = floorNative,
+		[MATH_CEIL] = ceilNative,
+		[MATH_ABS] = absNative,
+		[MATH_SIN] = sinNative,
+		[MATH_COS] = cosNative,
+		[MATH_TAN] = tanNative,
+		[MATH_EXP] = expNative,
+		[MATH_LOG] = logNative,
+		[MATH_POW] = powNative,
+		[MATH_ATAN2] = atan2Native,
+		[MATH_MIN] = minNative,
+		[MATH_MAX] = maxNative,
+	};
+	for (int i = 0; i < MATH_FUNCTION_COUNT; i++) {
+		defineNative(mathFunctions[i].name, mathNatives[i]);
+	}
+}
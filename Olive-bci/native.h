@@ -0,0 +1,32 @@
+#ifndef olive_native_h
+#define olive_native_h
+
+#include "common.h"
+#include "value.h"
+
+/* The math natives. Called by name, and not shadowed by a local, an upvalue or a global declared before, they compile to OP_MATH instead of a call of the native. */
+typedef enum {
+	// one argument
+	MATH_SQRT,
+	MATH_FLOOR,
+	MATH_CEIL,
+	MATH_ABS,
+	MATH_SIN,
+	MATH_COS,
+	MATH_TAN,
+	MATH_EXP,
+	MATH_LOG,
+	// two arguments
+	MATH_POW,
+	MATH_ATAN2,
+	MATH_MIN,
+	MATH_MAX,
+	MATH_FUNCTION_COUNT,
+} MathFunction;
+
+void initNatives();
+int mathFunction(const char* name, int length);
+const char* mathFunctionName(MathFunction function);
+Value mathNative(MathFunction function, int argCount, Value* args);
+
+#endif
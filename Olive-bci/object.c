@@ -1,4 +1,6 @@
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "memory.h"
@@ -31,20 +33,28 @@ ObjClass* newClass(ObjString* name) {
 	initTable(&c->methods);
 	c->name = name;
 	c->initCall = NULL_VAL;
+	c->vtable = NULL;
+	c->vtableBase = 0;
+	c->vtableCount = 0;
 	return c;	
 }
 
+/* Closures without upvalues carry no state of their own, so every evaluation of such a function shares one closure. */
 ObjClosure* newClosure(ObjFunction* function) {
-	ObjUpvalue** upvalues = ALLOCATE(ObjUpvalue*, function->upvalueCount);
-	
-	for (int i = 0; i < function->upvalueCount; i++) {
-		upvalues[i] = NULL;
+	if (function->upvalueCount == 0 && function->closure != NULL) {
+		return function->closure;
 	}
 	
-	ObjClosure* closure = ALLOCATE_OBJ(ObjClosure, OBJ_CLOSURE);
+	ObjClosure* closure = (ObjClosure*)allocateObject(sizeof(ObjClosure) + sizeof(ObjUpvalue*) * function->upvalueCount, OBJ_CLOSURE);
 	closure->function = function;
-	closure->upvalues = upvalues;
 	closure->upvalueCount = function->upvalueCount;
+	for (int i = 0; i < function->upvalueCount; i++) {
+		closure->upvalues[i] = NULL;
+	}
+	
+	if (function->upvalueCount == 0) {
+		function->closure = closure;
+	}
 	return closure;
 }
 
@@ -54,6 +64,7 @@ ObjFunction* newFunction(ValueArray* constants) {
 	function->arity = 0;
 	function->upvalueCount = 0;
 	function->name = NULL;
+	function->closure = NULL;
 	initChunk(&function->chunk, constants);
 	return function;
 }
@@ -65,41 +76,185 @@ ObjInstance* newInstance(ObjClass* c) {
 	return instance;
 }
 
+ObjList* newList() {
+	ObjList* list = ALLOCATE_OBJ(ObjList, OBJ_LIST);
+	initValueArray(&list->items);
+	return list;
+}
+
+/* A zero-filled array of 'count' doubles. */
+ObjFloat64Array* newFloat64Array(int count) {
+	// the array first, rooted while its buffer is allocated: if that runs out of memory, the empty array is left to the GC instead of a buffer nothing owns.
+	ObjFloat64Array* array = ALLOCATE_OBJ(ObjFloat64Array, OBJ_FLOAT64_ARRAY);
+	array->count = 0;
+	array->data = NULL;
+	push(OBJ_VAL(array));
+	double* data = ALLOCATE(double, count);
+	memset(data, 0, sizeof(double) * count);
+	array->count = count;
+	array->data = data;
+	pop(1);
+	return array;
+}
+
+ObjMap* newMap() {
+	ObjMap* map = ALLOCATE_OBJ(ObjMap, OBJ_MAP);
+	initTable(&map->table);
+	return map;
+}
+
+ObjRange* newRange(Value start, Value end, Value step) {
+	ObjRange* range = ALLOCATE_OBJ(ObjRange, OBJ_RANGE);
+	range->start = start;
+	range->end = end;
+	range->step = step;
+	return range;
+}
+
+/* The number of values in a range. */
+double rangeLength(ObjRange* range) {
+	double length = ceil((AS_NUMBER(range->end) - AS_NUMBER(range->start)) / AS_NUMBER(range->step));
+	return length > 0 ? length : 0;
+}
+
+/* The table key for a map key. String keys are flattened and interned in place, so equal strings are the same key; 'value' has to be a stack slot, which keeps the string a GC root. Returns false for values that can't be keys. */
+bool valueToKey(Value* value, Key* key) {
+	switch (value->type) {
+		case VAL_BOOL:
+			*key = (Key){.type = VAL_BOOL, .as.boolean = AS_BOOL(*value)};
+			return true;
+		case VAL_INT:
+			*key = (Key){.type = VAL_INT, .as.integer = AS_INT(*value)};
+			return true;
+		case VAL_NUMBER: {
+			// NaN never equals itself, so it could be stored but never found again.
+			double number = AS_DOUBLE(*value);
+			if (isnan(number)) return false;
+			// 1 and 1.0 are equal, so a whole double is the same key as the integer.
+			if (number >= -9223372036854775808.0 && number < 9223372036854775808.0 && number == trunc(number)) {
+				*key = (Key){.type = VAL_INT, .as.integer = (int64_t)number};
+			} else {
+				*key = (Key){.type = VAL_NUMBER, .as.number = number};
+			}
+			return true;
+		}
+		case VAL_OBJ: {
+			if (!IS_STRING(*value)) return false;
+			ObjString* string = flattenString(AS_STRING(*value));
+			string = internString(string);
+			*value = OBJ_VAL(string);
+			*key = OBJ_KEY(string);
+			return true;
+		}
+		default:
+			return false;
+	}
+}
+
+Value keyToValue(Key* key) {
+	switch (key->type) {
+		case VAL_BOOL: return BOOL_VAL(key->as.boolean);
+		case VAL_INT: return INT_VAL(key->as.integer);
+		case VAL_NUMBER: return NUMBER_VAL(key->as.number);
+		default: return OBJ_VAL(key->as.obj);
+	}
+}
+
 ObjNative* newNative(NativeFunction function) {
 	ObjNative* native = ALLOCATE_OBJ(ObjNative, OBJ_NATIVE);
 	native->function = function;
 	return native;
 }
 
-static uint32_t hashString(const char* key, int length) {
-	uint32_t hash = 2166136261u;
+static inline uint64_t hashMix(uint64_t a, uint64_t b) {
+	__uint128_t product = (__uint128_t)a * b;
+	return (uint64_t)product ^ (uint64_t)(product >> 64);
+}
+
+static inline uint64_t read64(const char* p) {
+	uint64_t word;
+	memcpy(&word, p, sizeof(word));
+	return word;
+}
+
+static inline uint64_t read32(const char* p) {
+	uint32_t word;
+	memcpy(&word, p, sizeof(word));
+	return word;
+}
+
+/* wyhash-style string hash: 16 bytes per round folded with a 64x64->128 bit multiply, seeded with vm.hashSeed. Never returns 0, which marks a hash that hasn't been computed yet. */
+uint32_t hashString(const char* key, int length) {
+	const uint64_t p0 = 0xa0761d6478bd642full;
+	const uint64_t p1 = 0xe7037ed1a0b428dbull;
+	uint64_t seed = vm.hashSeed ^ p0;
+	size_t remaining = (size_t)length;
+	uint64_t a;
+	uint64_t b;
 	
-	for (int i = 0; i < length; i++) {
-		hash ^= key[i];
-		hash *= 16777619;
+	if (remaining <= 16) {
+		if (remaining >= 4) {
+			// two overlapping reads from each end cover every byte.
+			size_t middle = (remaining >> 3) << 2;
+			a = (read32(key) << 32) | read32(key + middle);
+			b = (read32(key + remaining - 4) << 32) | read32(key + remaining - 4 - middle);
+		} else if (remaining > 0) {
+			a = ((uint64_t)(uint8_t)key[0] << 16) | ((uint64_t)(uint8_t)key[remaining >> 1] << 8) | (uint8_t)key[remaining - 1];
+			b = 0;
+		} else {
+			a = 0;
+			b = 0;
+		}
+	} else {
+		const char* p = key;
+		while (remaining > 16) {
+			seed = hashMix(read64(p) ^ p1, read64(p + 8) ^ seed);
+			p += 16;
+			remaining -= 16;
+		}
+		// the last 16 bytes of the key, overlapping the previous round if need be.
+		a = read64(p + remaining - 16);
+		b = read64(p + remaining - 8);
 	}
 	
-	return hash;
+	uint64_t hash = hashMix(p1 ^ (uint64_t)length, hashMix(a ^ p1, b ^ seed));
+	uint32_t folded = (uint32_t)(hash ^ (hash >> 32));
+	return folded != 0 ? folded : 1;
 }
 
-// does not own their copy of character array. Points back to source string but doesn't free source string
+/* The hash of a flat string, computed on first use. */
+uint32_t stringHash(ObjString* string) {
+	if (string->hash == 0) {
+		string->hash = hashString(string->chars, string->length);
+	}
+	return string->hash;
+}
+
+/* Intern a string. With 'ownString' the string keeps its own copy of chars, stored inline after the object. Otherwise it points at chars, which must outlive it (source code strings). */
 ObjString* allocateString(bool ownString, const char* chars, int length) {
 	// Check whether string is stored in string table already
 	uint32_t hash = hashString(chars, length);
 	ObjString* interned = tableFindString(&vm.strings, chars, length, hash);
 	if (interned != NULL) { //  if string is stored already in string table
-		if (ownString) {
-			FREE_ARRAY(char, (char*)chars, length + 1);
-		}
 		return interned;
 	}
 
-	// ObjString points directly into the source code.
-	ObjString* string = (ObjString*)allocateObject(sizeof(ObjString), OBJ_STRING);
-	string->length = length;
-	string->chars = chars;
-	string->ownString = ownString;
+	ObjString* string;
+	if (ownString) {
+		string = makeString(length);
+		memcpy(string->inlineChars, chars, length);
+	} else {
+		// ObjString points directly into the source code.
+		string = (ObjString*)allocateObject(sizeof(ObjString), OBJ_STRING);
+		string->length = length;
+		string->chars = chars;
+		string->ownString = false;
+		string->detached = false;
+		string->left = NULL;
+		string->right = NULL;
+	}
 	string->hash = hash;
+	string->interned = true;
 	
 	push(OBJ_VAL(string));
 	tableSet(&vm.strings, &OBJ_KEY(string), NULL_VAL);
@@ -108,19 +263,43 @@ ObjString* allocateString(bool ownString, const char* chars, int length) {
 	return string;
 }
 
-void resolveStringInterns(size_t offset) {
-	Obj* object = vm.objects;
+/* Allocate a string with room for 'length' characters inline, in the same block as the object. The caller fills inlineChars. The string isn't interned. */
+ObjString* makeString(int length) {
+	ObjString* string = (ObjString*)allocateObject(sizeof(ObjString) + length + 1, OBJ_STRING);
+	string->length = length;
+	string->chars = string->inlineChars;
+	string->ownString = true;
+	string->interned = false;
+	string->detached = false;
+	string->hash = 0;
+	string->left = NULL;
+	string->right = NULL;
+	string->inlineChars[length] = '\0';
+	return string;
+}
 
-	/* Recall that Obj linked list of VM objects links backwards. i.e vm.objects points to the most recently added object and not the oldest added object. This function therfore starts checking from the most recently added object (and resolves it's chars if it's an OBJ_STRING) and stops right at the OBJ_NATIVE object. The OBJ_NATIVE object is one of the first objects to be added to the VM and preceeding it are the native functions and the init() constructor object. Those objects contain interned strings but do not need to be resolved as their references are not contained in the reallocated buffer */
+/* An un-interned copy of chars. */
+ObjString* copyString(const char* chars, int length) {
+	ObjString* string = makeString(length);
+	memcpy(string->inlineChars, chars, length);
+	return string;
+}
+
+/* Return the canonical copy of a flat string, interning it if nobody has yet. Table keys must go through here, tables compare keys by identity. */
+ObjString* internString(ObjString* string) {
+	if (string->interned) return string;
 	
-	while (object->type != OBJ_NATIVE) {
-		if (object->type == OBJ_STRING) {
-			ObjString* string = (ObjString*)object;
-			/* point to the location of chars in the newly reallocated buffer*/
-			string->chars += offset;
-		}
-		object = object->next;
+	uint32_t hash = stringHash(string);
+	ObjString* interned = tableFindString(&vm.strings, string->chars, string->length, hash);
+	if (interned != NULL) {
+		return interned;
 	}
+	
+	string->interned = true;
+	push(OBJ_VAL(string));
+	tableSet(&vm.strings, &OBJ_KEY(string), NULL_VAL);
+	pop(1);
+	return string;
 }
 
 ObjUpvalue* newUpvalue(Value* slot) {
@@ -131,9 +310,114 @@ ObjUpvalue* newUpvalue(Value* slot) {
 	return upvalue;
 }
 
-// own their copy of the character array. Points back to heap allocated string and frees string.
-ObjString* takeString(const char* chars, int length) {
-	return allocateString(true, chars, length);
+/* Concatenate without copying. Both operands must be reachable by the GC. */
+ObjString* newRope(ObjString* left, ObjString* right) {
+	// a flattened rope is as good as its flat string, and lets go of its children.
+	if (IS_ROPE(left) && left->right == NULL) left = left->left;
+	if (IS_ROPE(right) && right->right == NULL) right = right->left;
+	
+	ObjString* rope = ALLOCATE_OBJ(ObjString, OBJ_STRING);
+	rope->length = left->length + right->length;
+	rope->chars = NULL;
+	rope->ownString = false;
+	rope->interned = false;
+	rope->detached = false;
+	rope->hash = 0;
+	rope->left = left;
+	rope->right = right;
+	return rope;
+}
+
+/* Call 'visit' on each flat piece of a string or rope, left to right. Nothing is allocated on the managed heap, so no collection can run in between. */
+static void forEachPiece(ObjString* string, void (*visit)(ObjString* piece, void* context), void* context) {
+	// walk the tree with an explicit stack, ropes built in a loop are as deep as the loop is long.
+	// Like the GC's gray stack, it lives outside the managed heap: growing it through reallocate() could collect or unwind through outOfMemory() and leak it.
+	int pendingCount = 0;
+	int pendingCapacity = 0;
+	ObjString** pending = NULL;
+	ObjString* node = string;
+	
+	for (;;) {
+		if (IS_ROPE(node) && node->right != NULL) {
+			if (pendingCapacity < pendingCount + 1) {
+				pendingCapacity = GROW_CAPACITY(pendingCapacity);
+				ObjString** grown = realloc(pending, sizeof(ObjString*) * pendingCapacity);
+				if (grown == NULL) {
+					free(pending);
+					outOfMemory();
+				}
+				pending = grown;
+			}
+			pending[pendingCount++] = node->right;
+			node = node->left;
+			continue;
+		}
+		
+		visit(IS_ROPE(node) ? node->left : node, context);
+		
+		if (pendingCount == 0) break;
+		node = pending[--pendingCount];
+	}
+	
+	free(pending);
+}
+
+static void copyPiece(ObjString* piece, void* context) {
+	char** dest = (char**)context;
+	memcpy(*dest, piece->chars, piece->length);
+	*dest += piece->length;
+}
+
+/* Copy the characters of a string or rope to 'dest', which has room for string->length characters. */
+void copyStringChars(ObjString* string, char* dest) {
+	forEachPiece(string, copyPiece, &dest);
+}
+
+/* Return a flat string holding the characters of 'string'. Ropes are flattened once, the result is cached on the rope. */
+ObjString* flattenString(ObjString* string) {
+	if (!IS_ROPE(string)) return string;
+	if (string->right == NULL) return string->left;
+	
+	push(OBJ_VAL(string));
+	ObjString* result = makeString(string->length);
+	push(OBJ_VAL(result));
+	copyStringChars(string, result->inlineChars);
+	
+	string->left = result;
+	string->right = NULL;
+	pop(2);
+	return result;
+}
+
+/* A substring of a flat string that shares its characters. The parent must be reachable by the GC. */
+ObjString* newView(ObjString* parent, int start, int length) {
+	if (IS_VIEW(parent)) {
+		start += (int)(parent->chars - parent->left->chars);
+		parent = parent->left;
+	}
+	
+	ObjString* view = ALLOCATE_OBJ(ObjString, OBJ_STRING);
+	view->length = length;
+	view->chars = parent->chars + start;
+	view->ownString = false;
+	view->interned = false;
+	view->detached = false;
+	view->hash = 0;
+	view->left = parent;
+	view->right = NULL;
+	return view;
+}
+
+ObjStringBuilder* newStringBuilder() {
+	ObjStringBuilder* builder = ALLOCATE_OBJ(ObjStringBuilder, OBJ_STRING_BUILDER);
+	builder->length = 0;
+	builder->capacity = 0;
+	builder->chars = NULL;
+	return builder;
+}
+
+static void printPiece(ObjString* piece, void* context) {
+	printf("%.*s", piece->length, piece->chars);
 }
 
 static void printFunction(ObjFunction* function) {
@@ -158,6 +442,17 @@ void printObject(Value value) {
 		case OBJ_CLOSURE:
 			printFunction(AS_CLOSURE(value)->function);
 			break;
+		case OBJ_FLOAT64_ARRAY: {
+			ObjFloat64Array* array = AS_FLOAT64_ARRAY(value);
+			printf("Float64Array[");
+			for (int i = 0; i < array->count; i++) {
+				if (i > 0) printf(", ");
+				printValue(NUMBER_VAL(array->data[i]));
+			}
+			printf("]");
+			break;
+		}
+		
 		case OBJ_FUNCTION: {
 			printFunction(AS_FUNCTION(value));
 			break;
@@ -168,16 +463,71 @@ void printObject(Value value) {
 			break;
 		}
 		
+		case OBJ_LIST: {
+			ObjList* list = AS_LIST(value);
+			printf("[");
+			for (int i = 0; i < list->items.count; i++) {
+				if (i > 0) printf(", ");
+				// a list holding itself would print forever.
+				if (IS_OBJ(list->items.values[i]) && AS_OBJ(list->items.values[i]) == (Obj*)list) {
+					printf("[...]");
+				} else {
+					printValue(list->items.values[i]);
+				}
+			}
+			printf("]");
+			break;
+		}
+		
+		case OBJ_MAP: {
+			// entries are read in place: printing a key or value must not allocate, or a collection could free the map or a rope flattened into it mid-walk.
+			Table* table = &AS_MAP(value)->table;
+			bool first = true;
+			printf("{");
+			for (int i = 0; i <= table->capacity; i++) {
+				Entry* entry = &table->entries[i];
+				if (IS_NULL(entry->key)) continue;
+				
+				if (!first) printf(", ");
+				first = false;
+				printValue(keyToValue(&entry->key));
+				printf(": ");
+				if (IS_OBJ(entry->value) && AS_OBJ(entry->value) == (Obj*)AS_MAP(value)) {
+					printf("{...}");
+				} else {
+					printValue(entry->value);
+				}
+			}
+			printf("}");
+			break;
+		}
+		
 		case OBJ_NATIVE: {
 			printf("<native function>");
 			break;
 		}
 		
+		case OBJ_RANGE: {
+			ObjRange* range = AS_RANGE(value);
+			printf("range(");
+			printValue(range->start);
+			printf(", ");
+			printValue(range->end);
+			printf(", ");
+			printValue(range->step);
+			printf(")");
+			break;
+		}
+		
 		case OBJ_STRING: {
-			printf("%.*s", AS_STRING(value)->length, AS_CSTRING(value));
+			// a rope is printed piece by piece: flattening it would allocate, and printing must not start a collection.
+			forEachPiece(AS_STRING(value), printPiece, NULL);
 			break;
 		}
 		
+		case OBJ_STRING_BUILDER:
+			printf("<string builder>");
+			break;
 		case OBJ_UPVALUE:
 			printf("upvalue");
 			break;
@@ -15,6 +15,11 @@
 #define IS_INSTANCE(value)	isObjType(value, OBJ_INSTANCE)
 #define IS_NATIVE(value)	isObjType(value, OBJ_NATIVE)
 #define IS_STRING(value)	isObjType(value, OBJ_STRING)
+#define IS_FLOAT64_ARRAY(value)	isObjType(value, OBJ_FLOAT64_ARRAY)
+#define IS_LIST(value)		isObjType(value, OBJ_LIST)
+#define IS_MAP(value)		isObjType(value, OBJ_MAP)
+#define IS_RANGE(value)		isObjType(value, OBJ_RANGE)
+#define IS_STRING_BUILDER(value)	isObjType(value, OBJ_STRING_BUILDER)
 
 #define AS_BOUND_METHOD(value)	((ObjBoundMethod*)AS_OBJ(value))
 #define AS_CLASS(value)		((ObjClass*)AS_OBJ(value))
@@ -24,15 +29,35 @@
 #define AS_NATIVE(value)	(((ObjNative*)AS_OBJ(value))->function)
 #define AS_STRING(value)	((ObjString*)AS_OBJ(value))
 #define AS_CSTRING(value)	(((ObjString*)AS_OBJ(value))->chars)
+#define AS_FLOAT64_ARRAY(value)	((ObjFloat64Array*)AS_OBJ(value))
+#define AS_LIST(value)		((ObjList*)AS_OBJ(value))
+#define AS_MAP(value)		((ObjMap*)AS_OBJ(value))
+#define AS_RANGE(value)		((ObjRange*)AS_OBJ(value))
+#define AS_STRING_BUILDER(value)	((ObjStringBuilder*)AS_OBJ(value))
+
+#define IS_ROPE(string)		((string)->chars == NULL)
+#define IS_VIEW(string)		((string)->chars != NULL && (string)->left != NULL)
+
+// concatenations at least this long build a rope instead of copying both operands.
+#define ROPE_MIN_LENGTH	256
+// substrings shorter than this are copied rather than viewed.
+#define VIEW_MIN_LENGTH	32
+// the collector detaches a view from a parent nothing else reaches once the parent is this many times longer.
+#define VIEW_DETACH_RATIO	8
 
 typedef enum {
 	OBJ_BOUND_METHOD,
 	OBJ_CLASS,
 	OBJ_CLOSURE,
+	OBJ_FLOAT64_ARRAY,
 	OBJ_FUNCTION,
 	OBJ_INSTANCE,
+	OBJ_LIST,
+	OBJ_MAP,
 	OBJ_NATIVE,
+	OBJ_RANGE,
 	OBJ_STRING,
+	OBJ_STRING_BUILDER,
 	OBJ_UPVALUE,
 } ObjType;
 
@@ -42,12 +67,15 @@ struct Obj {
 	struct Obj* next;
 };
 
+typedef struct ObjClosure ObjClosure;
+
 typedef struct {
 	Obj obj;
 	int arity;
 	int upvalueCount;
 	Chunk chunk;
 	ObjString* name;
+	ObjClosure* closure; // shared closure of a function without upvalues, created on first use
 } ObjFunction;
 
 typedef Value (*NativeFunction)(int argCount, Value* args);
@@ -57,14 +85,29 @@ typedef struct {
 	NativeFunction function;
 } ObjNative;
 
+/* Owned strings (ownString) keep their characters inline, right after the object. Strings made at runtime aren't interned until they're needed as a table key (see internString()). A rope is a string built lazily by concatenation: chars is NULL and the characters are those of 'left' followed by those of 'right'. Once flattened, 'left' caches the flat string and 'right' is NULL.
+A view is a substring borrowing the characters of its parent 'left' (a flat string, never a view). Views don't keep their parent alive on their own, see settleViews(): a detached view has its own heap copy of its characters. */
 struct ObjString {
 	Obj obj;
 	int length;
 	bool ownString;
+	bool interned; // the canonical copy in vm.strings
+	bool detached; // chars is a heap block of its own (a view whose parent was collected)
 	const char* chars;
-	uint32_t hash;	
+	uint32_t hash; // 0 until stringHash() computes it
+	struct ObjString* left;
+	struct ObjString* right;
+	char inlineChars[]; // where 'chars' points for owned strings
 };
 
+/* Growable character buffer for building a string piece by piece, interned once at the end. */
+typedef struct {
+	Obj obj;
+	int length;
+	int capacity;
+	char* chars;
+} ObjStringBuilder;
+
 typedef struct ObjUpvalue {
 	Obj obj;
 	Value* location;
@@ -72,18 +115,21 @@ typedef struct ObjUpvalue {
 	struct ObjUpvalue* next;
 } ObjUpvalue;
 
-typedef struct {
+struct ObjClosure {
 	Obj obj;
 	ObjFunction* function;
-	ObjUpvalue** upvalues;
 	int upvalueCount;
-} ObjClosure;
+	ObjUpvalue* upvalues[]; // allocated along with the closure
+};
 
 typedef struct {
 	Obj obj;
 	ObjString* name;
 	Value initCall;
 	Table methods;
+	ObjClosure** vtable; // methods indexed by selector - vtableBase, built by OP_END_CLASS. NULL if the class' selectors are too spread out
+	int vtableBase;
+	int vtableCount;
 } ObjClass;
 
 typedef struct {
@@ -98,15 +144,57 @@ typedef struct {
 	ObjClosure* method;
 } ObjBoundMethod;
 
+/* A growable array of values, indexed with list[i]. */
+typedef struct {
+	Obj obj;
+	ValueArray items;
+} ObjList;
+
+/* A fixed-length array of raw doubles, for the bulk numeric natives. */
+typedef struct {
+	Obj obj;
+	int count;
+	double* data;
+} ObjFloat64Array;
+
+/* A dictionary keyed by numbers, strings and booleans, written {k: v}. */
+typedef struct {
+	Obj obj;
+	Table table;
+} ObjMap;
+
+/* The numbers from 'start' up to but excluding 'end', 'step' apart, made by range(). A for-in walks it by arithmetic, without making anything. */
+typedef struct {
+	Obj obj;
+	Value start;
+	Value end;
+	Value step;
+} ObjRange;
+
 ObjBoundMethod* newBoundMethod(Value reciever, ObjClosure* method);
 ObjClass* newClass(ObjString* name);
 ObjClosure* newClosure(ObjFunction* function);
 ObjFunction* newFunction(ValueArray* constants);
 ObjInstance* newInstance(ObjClass* c);
+ObjList* newList();
+ObjFloat64Array* newFloat64Array(int count);
+ObjMap* newMap();
+ObjRange* newRange(Value start, Value end, Value step);
+double rangeLength(ObjRange* range);
+bool valueToKey(Value* value, Key* key);
+Value keyToValue(Key* key);
 ObjNative* newNative(NativeFunction function);
-ObjString* takeString(const char* chars, int length);
+uint32_t hashString(const char* key, int length);
+uint32_t stringHash(ObjString* string);
+ObjString* makeString(int length);
+ObjString* copyString(const char* chars, int length);
+ObjString* internString(ObjString* string);
+ObjString* newRope(ObjString* left, ObjString* right);
+ObjString* flattenString(ObjString* string);
+ObjString* newView(ObjString* parent, int start, int length);
+void copyStringChars(ObjString* string, char* dest);
+ObjStringBuilder* newStringBuilder();
 ObjString* allocateString(bool ownString, const char* chars, int length);
-void resolveStringInterns(size_t offset);
 ObjUpvalue* newUpvalue(Value* slot);
 void printObject(Value value);
 
@@ -7,6 +7,7 @@
 static int interpolationCount = 0;
 static bool inInterpolation = false;
 static bool interpolatedString = false;
+static bool resumeString = false; // the '}' closing an interpolated expression was just scanned
 
 typedef struct {
 	const char* start;
@@ -24,6 +25,10 @@ void initScanner(const char* source, size_t len) {
 	scanner.line = 1;
 	scanner.index = 0;
 	scanner.end = len;
+	interpolationCount = 0;
+	inInterpolation = false;
+	interpolatedString = false;
+	resumeString = false;
 }
 
 static bool isAlpha(char c) {
@@ -176,6 +181,7 @@ static TokenType identifierType() {
 			break;
 		case 'd':
 			if ((scanner.current - scanner.start) == 3) {
+				if (scanner.start[1] == 'i') return checkKeyword(2,1, "v", TOKEN_DIV);
 				return checkKeyword(1,2, "ef", TOKEN_DEF);
 			} else if ((scanner.current - scanner.start) == 7) {
 				return checkKeyword(1,6, "efault", TOKEN_SWITCHDEFAULT);
@@ -192,7 +198,14 @@ static TokenType identifierType() {
 				}
 			}
 			break;
-		case 'i': return checkKeyword(1,1, "f", TOKEN_IF);
+		case 'i':
+			if (scanner.current - scanner.start > 1) {
+				switch(scanner.start[1]) {
+					case 'f': return checkKeyword(2,0,"", TOKEN_IF);
+					case 'n': return checkKeyword(2,0,"", TOKEN_IN);
+				}
+			}
+			break;
 		case 'm': return checkKeyword(1,2, "od", TOKEN_MOD);
 		case 'n': {
 			if (scanner.current - scanner.start > 1) {
@@ -223,7 +236,7 @@ static TokenType identifierType() {
 
 static Token interpolation() {
 	Token token = makeToken(TOKEN_INTERPOLATION);
-	scanner.current+=1;
+	advance(); // skip the '$'
 	return token;
 }
 
@@ -275,6 +288,13 @@ static Token number() {
 
 // TODO: scan user enforced new line characters. That is, when the user types '\' and 'n'.
 Token scanToken() {
+	if (resumeString) {
+		// the literal carries on right after the '}', whatever the character.
+		resumeString = false;
+		scanner.start = scanner.current;
+		return string();
+	}
+	
 	skipWhitespace();
 	if (newLine) {
 		newLine = false;
@@ -318,7 +338,7 @@ Token scanToken() {
 		
 		case '}': { 
 			if (interpolatedString) {
-				inInterpolation = true;
+				resumeString = true;
 				interpolationCount--;
 				return makeConcatToken(TOKEN_CONCAT);
 			}
@@ -326,6 +346,8 @@ Token scanToken() {
 			return makeToken(TOKEN_RIGHT_BRACE);
 		}
 		
+		case '[': return makeToken(TOKEN_LEFT_BRACKET);
+		case ']': return makeToken(TOKEN_RIGHT_BRACKET);
 		case ';': return makeToken(TOKEN_SEMICOLON);
 		case ',': return makeToken(TOKEN_COMMA);
 		case '.': return makeToken(TOKEN_DOT);
@@ -352,3 +374,26 @@ Token scanToken() {
 	
 	return errorToken("Unexpected character.");
 }
+
+/* scan the token after the current one without consuming it, skipping new lines. The compiler uses it where one token of lookahead isn't enough, as in 'for (x in ...)'. */
+Token peekToken() {
+	Scanner saved = scanner;
+	int savedInterpolationCount = interpolationCount;
+	bool savedInInterpolation = inInterpolation;
+	bool savedInterpolatedString = interpolatedString;
+	bool savedResumeString = resumeString;
+	bool savedNewLine = newLine;
+	
+	Token token;
+	do {
+		token = scanToken();
+	} while (token.type == TOKEN_NEWLINE);
+	
+	scanner = saved;
+	interpolationCount = savedInterpolationCount;
+	inInterpolation = savedInInterpolation;
+	interpolatedString = savedInterpolatedString;
+	resumeString = savedResumeString;
+	newLine = savedNewLine;
+	return token;
+}
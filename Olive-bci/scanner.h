@@ -5,8 +5,9 @@ typedef enum {
 	// Single-character tokens.
 	TOKEN_LEFT_PAREN, TOKEN_RIGHT_PAREN,
 	TOKEN_LEFT_BRACE, TOKEN_RIGHT_BRACE,
+	TOKEN_LEFT_BRACKET, TOKEN_RIGHT_BRACKET,
 	TOKEN_COMMA, TOKEN_DOT, TOKEN_MINUS, TOKEN_PLUS,
-	TOKEN_SEMICOLON, TOKEN_SLASH, TOKEN_MOD, TOKEN_STAR, TOKEN_QUESTION_MARK, TOKEN_COLON,
+	TOKEN_SEMICOLON, TOKEN_SLASH, TOKEN_MOD, TOKEN_DIV, TOKEN_STAR, TOKEN_QUESTION_MARK, TOKEN_COLON,
 	TOKEN_PERCENT,
 	// One or two character tokens.
 	TOKEN_BANG, TOKEN_BANG_EQUAL,
@@ -17,7 +18,7 @@ typedef enum {
 	TOKEN_IDENTIFIER, TOKEN_STRING, TOKEN_NUMBER,
 	// Keywords. // NIL TO NULL, SUPER TO BASE, FUN TO DEF
 	TOKEN_AND, TOKEN_CLASS, TOKEN_ELSE, TOKEN_FALSE,
-	TOKEN_FOR, TOKEN_DEF, TOKEN_IF, TOKEN_NULL, TOKEN_OR,
+	TOKEN_FOR, TOKEN_DEF, TOKEN_IF, TOKEN_IN, TOKEN_NULL, TOKEN_OR,
 	TOKEN_PRINT, TOKEN_RETURN, TOKEN_BASE, TOKEN_THIS,
 	TOKEN_TRUE, TOKEN_VAR, TOKEN_WHILE, TOKEN_SWITCH, TOKEN_SWITCHCASE, TOKEN_SWITCHDEFAULT, TOKEN_BREAK, TOKEN_CONTINUE, TOKEN_DELATTR,
 	TOKEN_ERROR, TOKEN_CONST, TOKEN_NEWLINE, TOKEN_NL,
@@ -35,5 +36,6 @@ typedef struct {
 
 void initScanner(const char* source, size_t len);
 Token scanToken();
+Token peekToken();
 
 #endif
@@ -1,17 +1,12 @@
 #include "stack.h"
 #include "memory.h"
 
-void initStack(Stack* stack) {
+/* The stack is allocated once at its full size and never moves, so pointers into it stay valid across allocations. */
+void initStack(Stack* stack, int capacity) {
 	stack->count = 0;
 	stack->capacity = 0;
-	stack->stack = NULL;
-	growStack(stack);
-}
-
-void growStack(Stack* stack) {
-	int oldCapacity = stack->capacity;
-	stack->capacity = GROW_STACK_CAPACITY(oldCapacity);
-	stack->stack = GROW_ARRAY(Value, stack->stack, oldCapacity, stack->capacity);
+	stack->stack = GROW_ARRAY(Value, NULL, 0, capacity);
+	stack->capacity = capacity;
 }
 
 void freeStack(Stack* stack) {
@@ -9,8 +9,7 @@ typedef struct {
 	Value* stack;	
 } Stack;
 
-void initStack(Stack* stack);
+void initStack(Stack* stack, int capacity);
 void freeStack(Stack* stack);
-void growStack(Stack* stack);
 
 #endif
@@ -1,203 +1,306 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "memory.h"
 #include "object.h"
 #include "table.h"
 #include "value.h"
 #include "vm.h"
 
-#define TABLE_MAX_LOAD 0.75
+// at most 7/8 of the slots may be in use, live or deleted.
+#define MAX_USED(slots) ((slots) - (slots) / 8)
 
-#define KEYASVALUE(key) ((Value*)key)
+#define H1(hash) ((hash) >> 7)
+#define H2(hash) ((uint8_t)((hash) & 0x7f))
 
 void initTable(Table* table) {
 	table->count = 0;
+	table->used = 0;
 	table->capacity = -1;
+	table->control = NULL;
 	table->entries = NULL;
 }
 
+static size_t tableBytes(int slots) {
+	return (sizeof(Entry) + sizeof(uint8_t)) * (size_t)slots;
+}
+
 void freeTable(Table* table) {
-	FREE_ARRAY(Entry, table->entries, table->capacity + 1);
+	if (table->entries != NULL) {
+		reallocate(table->entries, tableBytes(table->capacity + 1), 0);
+	}
 	initTable(table);
 }
 
-static Entry* findEntry(Entry* entries, int capacity, Key* key) {
-	uint32_t index;
-	
-	Value* keyAsValue = KEYASVALUE(key);
-	switch(keyAsValue->type) {
-		case VAL_BOOL:
-			index = (AS_BOOL(*keyAsValue) == true ? 1 : 0) & capacity;
-			break;
-		case VAL_NULL:
-			index = 0;
-			break;
-		case VAL_NUMBER:
-			index = (int)AS_NUMBER(*keyAsValue) & capacity;
-			break;
-		case VAL_OBJ:
-			index = AS_STRING(*keyAsValue)->hash & capacity;
-			break;
+/* Bitmask of the slots in the group at 'control' whose control byte is 'byte'. */
+static inline uint32_t matchByte(const uint8_t* control, uint8_t byte) {
+#ifdef __SSE2__
+	__m128i group = _mm_loadu_si128((const __m128i*)control);
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)byte)));
+#else
+	uint32_t mask = 0;
+	for (int i = 0; i < GROUP_WIDTH; i++) {
+		if (control[i] == byte) mask |= 1u << i;
 	}
+	return mask;
+#endif
+}
+
+/* Bitmask of the empty or deleted slots in a group. Both have the high bit set, full slots don't. */
+static inline uint32_t matchFree(const uint8_t* control) {
+#ifdef __SSE2__
+	return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)control));
+#else
+	uint32_t mask = 0;
+	for (int i = 0; i < GROUP_WIDTH; i++) {
+		if (control[i] & 0x80) mask |= 1u << i;
+	}
+	return mask;
+#endif
+}
+
+static uint32_t hashBits(uint64_t bits) {
+	bits ^= vm.hashSeed;
+	bits *= 0x9e3779b97f4a7c15u;
+	bits ^= bits >> 29;
+	bits *= 0xbf58476d1ce4e5b9u;
+	return (uint32_t)(bits ^ (bits >> 32));
+}
+
+/* Number keys are never 0 or -0.0 as doubles, valueToKey() turns integral doubles into integers. */
+static uint32_t hashNumber(double number) {
+	uint64_t bits;
+	memcpy(&bits, &number, sizeof(bits));
+	return hashBits(bits);
+}
+
+static uint32_t hashKey(Key* key) {
+	switch (key->type) {
+		case VAL_BOOL: return key->as.boolean ? 0x9e3779b9u : 0x7f4a7c15u;
+		case VAL_INT: return hashBits((uint64_t)key->as.integer);
+		case VAL_NUMBER: return hashNumber(key->as.number);
+		case VAL_OBJ: return stringHash(key->as.obj);
+		default: return 0;
+	}
+}
+
+static inline bool keysEqual(Key* a, Key* b) {
+	if (a->type != b->type) return false;
 	
-	Entry* tombstone = NULL;
-	
-	for (;;) {
-		Entry* entry = &entries[index];
-		
-		if (IS_NULL(entry->key)) {
-			if(IS_NULL(entry->value)) {
-				// Found an empty entry.
-				return tombstone != NULL ? tombstone : entry;
-			} else {
-				// Found a tombstone.
-				if (tombstone == NULL) tombstone = entry;
-			}
-		} else {
-				// Found a non-empty, non-tombstone entry.
-				switch((entry->key).type) {
-					case VAL_BOOL:
-						if (AS_BOOL(*keyAsValue) == AS_BOOL(entry->key)) return entry;
-					case VAL_NUMBER:
-						if (AS_NUMBER(*keyAsValue) == AS_NUMBER(entry->key)) return entry;
-					case VAL_OBJ:
-						if (AS_STRING(*keyAsValue) == AS_STRING(entry->key)) return entry;
-					case VAL_NULL:
-						// check for errors
-						if (IS_NULL(entry->key)) return entry;
-						
-				}
+	switch (a->type) {
+		case VAL_BOOL: return a->as.boolean == b->as.boolean;
+		case VAL_INT: return a->as.integer == b->as.integer;
+		case VAL_NUMBER: return a->as.number == b->as.number;
+		case VAL_OBJ: return a->as.obj == b->as.obj;
+		default: return true;
+	}
+}
+
+/* Groups are visited in triangular order: 0, 1, 3, 6, ... apart. With a power of two group count that covers every group once. */
+#define FOR_EACH_GROUP(table, hash, group) \
+	for (int groupMask_ = ((table)->capacity + 1) / GROUP_WIDTH - 1, step_ = 0, group = H1(hash) & groupMask_; \
+		step_ <= groupMask_; step_++, group = (group + step_) & groupMask_)
+
+/* Index of the slot holding 'key', or -1. */
+static int findSlot(Table* table, Key* key, uint32_t hash) {
+	FOR_EACH_GROUP(table, hash, group) {
+		const uint8_t* control = table->control + group * GROUP_WIDTH;
+		for (uint32_t matches = matchByte(control, H2(hash)); matches != 0; matches &= matches - 1) {
+			int index = group * GROUP_WIDTH + __builtin_ctz(matches);
+			Entry* entry = &table->entries[index];
+			if (entry->key.hash == hash && keysEqual(&entry->key, key)) return index;
 		}
 		
-		index = (index + 1) & capacity;
+		// a key is never stored past a group that still had room for it.
+		if (matchByte(control, CTRL_EMPTY) != 0) return -1;
 	}
+	return -1;
 }
 
-bool tableGet(Table* table, Key* key, Value* value) {
-	if (table->count == 0) return false;
-	
-	Entry* entry = findEntry(table->entries, table->capacity, key);
-	if (entry == NULL) return false;
-	if (IS_NULL(entry->key)) return false;
-	
-	*value = entry->value;
-	return true;
+/* The first empty or deleted slot on the probe sequence of 'hash'. */
+static int findFreeSlot(Table* table, uint32_t hash) {
+	FOR_EACH_GROUP(table, hash, group) {
+		uint32_t free = matchFree(table->control + group * GROUP_WIDTH);
+		if (free != 0) return group * GROUP_WIDTH + __builtin_ctz(free);
+	}
+	return -1;
+}
+
+static void fillSlot(Table* table, int index, Key* key, uint32_t hash, Value value) {
+	if (table->control[index] == CTRL_EMPTY) table->used++;
+	table->control[index] = H2(hash);
+	table->entries[index].key = *key;
+	table->entries[index].key.hash = hash;
+	table->entries[index].value = value;
+	table->count++;
 }
 
-static void adjustCapacity(Table* table, int capacity) {
-	Entry* entries = ALLOCATE(Entry, capacity + 1);
-	for (int i = 0; i <= capacity; i++) {
+/* A freed slot only needs a deleted marker if some probe may have walked past it. Probes stop at the first group with an empty slot and groups never regain one once full, so a group that still has an empty slot has never turned a probe away and the slot can go straight back to empty. */
+static void eraseSlot(Table* table, int index) {
+	const uint8_t* group = table->control + index / GROUP_WIDTH * GROUP_WIDTH;
+	if (matchByte(group, CTRL_EMPTY) != 0) {
+		table->control[index] = CTRL_EMPTY;
+		table->used--;
+	} else {
+		table->control[index] = CTRL_DELETED;
+	}
+	table->entries[index].key = NULL_KEY;
+	table->entries[index].value = NULL_VAL;
+	table->count--;
+}
+
+/* Rebuild the table with 'slots' slots, dropping its deleted slots. Hashes are cached per entry, so no key is rehashed. */
+static void resizeTable(Table* table, int slots) {
+	Entry* entries = (Entry*)reallocate(NULL, 0, tableBytes(slots));
+	uint8_t* control = (uint8_t*)(entries + slots);
+	memset(control, CTRL_EMPTY, slots);
+	for (int i = 0; i < slots; i++) {
 		entries[i].key = NULL_KEY;
 		entries[i].value = NULL_VAL;
 	}
 	
-	table->count = 0;
+	Table resized = {0, 0, slots - 1, control, entries};
 	for (int i = 0; i <= table->capacity; i++) {
-		Entry* entry = &table->entries[i];
-		if (IS_NULL(entry->key)) continue;
+		if (table->control[i] & 0x80) continue;
 		
-		Entry* dest = findEntry(entries, capacity, &entry->key);
-		dest->key = entry->key;
-		dest->value = entry->value;
-		table->count++;
+		Entry* entry = &table->entries[i];
+		fillSlot(&resized, findFreeSlot(&resized, entry->key.hash), &entry->key, entry->key.hash, entry->value);
 	}
 	
-	FREE_ARRAY(Entry, table->entries, table->capacity + 1);
-	table->entries = entries;
-	table->capacity = capacity;
+	freeTable(table);
+	*table = resized;
 }
 
-bool tableSet(Table* table, Key* key, Value value) {
-	if(table->count + 1 > (table->capacity + 1) * TABLE_MAX_LOAD) {
-		int capacity = GROW_CAPACITY(table->capacity + 1) - 1;
-		adjustCapacity(table, capacity);
+/* The smallest table that holds 'count' entries at under half load. */
+static int fittingSlots(int count) {
+	int slots = GROUP_WIDTH;
+	while (MAX_USED(slots) / 2 < count) slots *= 2;
+	return slots;
+}
+
+/* Give memory back once a table has emptied out to an eighth of its size, so probe sequences over a long-lived table don't stay as long as at its peak. */
+static bool shrinkIfSparse(Table* table) {
+	int slots = table->capacity + 1;
+	if (slots <= GROUP_WIDTH || table->count > slots / 8) return false;
+	
+	resizeTable(table, fittingSlots(table->count));
+	return true;
+}
+
+/* Make room for one more entry. A table clogged with deleted slots is rebuilt at its current size instead of growing. */
+static void reserveSlot(Table* table) {
+	// tableRemoveWhite() can't resize in the middle of a collection, the table shrinks on its next insertion instead.
+	if (shrinkIfSparse(table)) return;
+	
+	int slots = table->capacity + 1;
+	if (table->used + 1 <= MAX_USED(slots)) return;
+	
+	if (slots == 0) {
+		resizeTable(table, GROUP_WIDTH);
+	} else if (table->count + 1 <= MAX_USED(slots) / 2) {
+		resizeTable(table, slots);
+	} else {
+		resizeTable(table, slots * 2);
 	}
+}
 
-	Entry* entry = findEntry(table->entries, table->capacity, key);
+bool tableGet(Table* table, Key* key, Value* value) {
+	if (table->count == 0) return false;
 	
-	bool isNewKey = IS_NULL(entry->key);
-	if (isNewKey && IS_NULL(entry->value)) table->count++;
+	int index = findSlot(table, key, hashKey(key));
+	if (index < 0) return false;
 	
-	entry->key = *key;
-	entry->value = value;
-	return isNewKey;
+	*value = table->entries[index].value;
+	return true;
 }
 
-bool tableSetGlobal(Table* table, Key* key, Value value) {
-	if(table->count + 1 > (table->capacity + 1) * TABLE_MAX_LOAD) {
-		int capacity = GROW_CAPACITY(table->capacity + 1) - 1;
-		adjustCapacity(table, capacity);
+bool tableSet(Table* table, Key* key, Value value) {
+	uint32_t hash = hashKey(key);
+	int index = table->count == 0 ? -1 : findSlot(table, key, hash);
+	if (index >= 0) {
+		table->entries[index].value = value;
+		return false;
 	}
-
-	Entry* entry = findEntry(table->entries, table->capacity, key);
 	
-	bool isNewKey = IS_NULL(entry->key);
-	if (isNewKey && IS_NULL(entry->value)) table->count++;
+	reserveSlot(table);
+	fillSlot(table, findFreeSlot(table, hash), key, hash, value);
+	return true;
+}
+
+/* Like tableSet() but an existing key keeps its value. */
+bool tableSetGlobal(Table* table, Key* key, Value value) {
+	uint32_t hash = hashKey(key);
+	if (table->count != 0 && findSlot(table, key, hash) >= 0) return false;
 	
-	entry->key = *key;
-	if (isNewKey) entry->value = value;
-	return isNewKey;
+	reserveSlot(table);
+	fillSlot(table, findFreeSlot(table, hash), key, hash, value);
+	return true;
 }
 
 bool tableDelete(Table* table, Key* key) {
 	if(table->count == 0) return false;
 	
-	// Find the entry
-	Entry* entry = findEntry(table->entries, table->capacity, key);
-	if(IS_NULL(entry->key)) return false;
-	
-	// Place a tombstone in the entry
-	entry->key = NULL_KEY;
-	entry->value = BOOL_VAL(true);
+	int index = findSlot(table, key, hashKey(key));
+	if (index < 0) return false;
 	
+	eraseSlot(table, index);
+	shrinkIfSparse(table);
 	return true;
 }
 
 // For method inheritance
 void tableAddAll(Table* from, Table* to) {
 	for (int i = 0; i <= from->capacity; i++) {
-		Entry* entry = &from->entries[i];
+		if (from->control[i] & 0x80) continue;
 		
-		if (IS_NULL(entry->key)) {
-			tableSet(to, &entry->key, entry->value);
-		}
+		Entry* entry = &from->entries[i];
+		tableSet(to, &entry->key, entry->value);
 	}
 }
 
 ObjString* tableFindString(Table* table, const char* chars, int length, uint32_t hash) {
 	if (table->count == 0) return NULL;
 	
-	uint32_t index = hash & table->capacity;
-	
-	for (;;) {
-		Entry* entry = &table->entries[index];
-		
-		if (IS_NULL(entry->key)) {
-			// Stop if we find an empty non-tombstone entry
-			if(IS_NULL(entry->value)) return NULL;
-		} else if (AS_STRING(entry->key)->length == length && AS_STRING(entry->key)->hash == hash && memcmp(AS_STRING(entry->key)->chars, chars, length) == 0) {
-			return AS_STRING(entry->key);
+	FOR_EACH_GROUP(table, hash, group) {
+		const uint8_t* control = table->control + group * GROUP_WIDTH;
+		for (uint32_t matches = matchByte(control, H2(hash)); matches != 0; matches &= matches - 1) {
+			Entry* entry = &table->entries[group * GROUP_WIDTH + __builtin_ctz(matches)];
+			ObjString* string = AS_STRING(entry->key);
+			if (entry->key.hash == hash && string->length == length && memcmp(string->chars, chars, length) == 0) {
+				return string;
+			}
 		}
-		index = (index + 1) & table->capacity;
+		
+		if (matchByte(control, CTRL_EMPTY) != 0) return NULL;
 	}
+	return NULL;
 }
 
 void tableRemoveWhite(Table* table) {
+	if (table->entries == NULL) return;
+	
 	for (int i = 0; i <= table->capacity; i++) {
-		if (table->entries == NULL) return;
+		if (table->control[i] & 0x80) continue;
+		
 		Entry* entry = &table->entries[i];
-		if (!IS_NULL(entry->key) && !((Obj*)(entry->key.as.obj))->isMarked) {
-			tableDelete(table, &entry->key);
+		if (!((Obj*)(entry->key.as.obj))->isMarked) {
+			eraseSlot(table, i);
 		}
 	}
 }
 
 void markTable(Table* table) {
+	if (table->entries == NULL) return;
+	
 	for (int i = 0; i <= table->capacity; i++) {
-		if (table->entries == NULL) return;
+		if (table->control[i] & 0x80) continue;
+		
 		Entry* entry = &table->entries[i];
-		markObject((Obj*)AS_OBJ(entry->key));
+		if (entry->key.type == VAL_OBJ) markObject((Obj*)entry->key.as.obj);
 		markValue(entry->value);
 	}
 }
@@ -4,17 +4,25 @@
 #include "common.h"
 #include "value.h"
 
-#define NULL_KEY         	((Key){VAL_NULL, {.number = 0}})
-#define OBJ_KEY(object)		((Key){VAL_OBJ, {.obj = object}})
+#define NULL_KEY         	((Key){.type = VAL_NULL})
+#define OBJ_KEY(object)		((Key){.type = VAL_OBJ, .as.obj = object})
+
+// slots probed per step. Tables are allocated in whole groups.
+#define GROUP_WIDTH 16
+
+// control bytes. A full slot stores the low 7 bits of its key's hash instead.
+#define CTRL_EMPTY 	0x80
+#define CTRL_DELETED	0xfe
 
 typedef struct {
 	ValueType type;
+	uint32_t hash; // cached by the table, callers leave it 0
 	union {
 		bool boolean;
+		int64_t integer;
 		double number;
 		ObjString* obj;
 	} as;
-	bool constant;
 } Key;
 
 typedef struct {
@@ -22,9 +30,12 @@ typedef struct {
 	Value value;
 } Entry;
 
+/* Swiss-table style open addressing. 'control' holds one byte per slot, so a probe compares the hash fragments of a whole group of slots at once and only touches the entries whose fragment matches. Empty and deleted slots keep a NULL_KEY entry. */
 typedef struct {
-	int count;
-	int capacity;
+	int count; // live entries
+	int used; // live entries plus deleted slots
+	int capacity; // slot count - 1, or -1 before the first insertion
+	uint8_t* control;
 	Entry* entries;
 } Table;
 
@@ -1,5 +1,10 @@
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "object.h"
 #include "memory.h"
@@ -14,8 +19,9 @@ void initValueArray(ValueArray* array) {
 void writeValueArray(ValueArray* array, Value value) {
 	if (array->capacity < array->count + 1) {
 		int oldCapacity = array->capacity;
-		array->capacity = GROW_CAPACITY(oldCapacity);
-		array->values = GROW_ARRAY(Value, array->values, oldCapacity, array->capacity);
+		int capacity = GROW_CAPACITY(oldCapacity);
+		array->values = GROW_ARRAY(Value, array->values, oldCapacity, capacity);
+		array->capacity = capacity;
 	}
 
 	array->values[array->count] = value;
@@ -27,30 +33,96 @@ void freeValueArray(ValueArray* array) {
 	initValueArray(array);
 }
 
+/* Write the digits of 'integer' to buffer. Returns the length written. */
+int formatInteger(int64_t integer, char* buffer) {
+	uint64_t magnitude = integer < 0 ? -(uint64_t)integer : (uint64_t)integer;
+	char digits[20];
+	int count = 0;
+	do {
+		digits[count++] = (char)('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude != 0);
+	
+	int length = 0;
+	if (integer < 0) buffer[length++] = '-';
+	while (count > 0) buffer[length++] = digits[--count];
+	buffer[length] = '\0';
+	return length;
+}
+
+/* Write text that reads back as exactly 'number'. Integral values below 2^53 take a fast path that writes the digits directly; everything else tries 15, 16 then 17 significant digits and keeps the first that round-trips. %g drops trailing zeros, so a value with a short decimal form such as 0.1 comes out short, but a value needing 16 or 17 digits isn't guaranteed its shortest form. Returns the length written to buffer (at least VALUE_TEXT_MAX bytes). */
+int formatNumber(double number, char* buffer) {
+	if (fabs(number) < 9007199254740992.0 && number == (double)(int64_t)number && !(number == 0 && signbit(number))) {
+		return formatInteger((int64_t)number, buffer);
+	}
+	
+	if (isnan(number) || isinf(number)) {
+		return snprintf(buffer, VALUE_TEXT_MAX, "%g", number);
+	}
+	
+	int length = 0;
+	for (int precision = 15; precision <= 17; precision++) {
+		length = snprintf(buffer, VALUE_TEXT_MAX, "%.*g", precision, number);
+		if (strtod(buffer, NULL) == number) break;
+	}
+	return length;
+}
+
 void printValue(Value value) {
 	switch(value.type) {
 		case VAL_BOOL:
 			printf(AS_BOOL(value) ? "true" : "false");
 			break;
 		case VAL_NULL: printf("null"); break;
-		case VAL_NUMBER: printf("%g", AS_NUMBER(value)); break;
+		case VAL_INT: {
+			char buffer[VALUE_TEXT_MAX];
+			int length = formatInteger(AS_INT(value), buffer);
+			fwrite(buffer, 1, length, stdout);
+			break;
+		}
+		case VAL_NUMBER: {
+			char buffer[VALUE_TEXT_MAX];
+			int length = formatNumber(AS_NUMBER(value), buffer);
+			fwrite(buffer, 1, length, stdout);
+			break;
+		}
 		case VAL_OBJ: printObject(value); break;
 		case VAL_NL: printf("\\n"); break;
 	}
 }
 
+/* Write the text a non-string value is converted to when it's concatenated to a string. Returns the length of the text, or -1 for values without a text form (objects). */
+int valueText(Value value, char* buffer) {
+	switch(value.type) {
+		case VAL_BOOL: return snprintf(buffer, VALUE_TEXT_MAX, "%s", AS_BOOL(value) ? "true" : "false");
+		case VAL_NULL: return snprintf(buffer, VALUE_TEXT_MAX, "NULL");
+		case VAL_INT: return formatInteger(AS_INT(value), buffer);
+		case VAL_NUMBER: return formatNumber(AS_NUMBER(value), buffer);
+		case VAL_NL: return snprintf(buffer, VALUE_TEXT_MAX, "\n");
+		default: return -1;
+	}
+}
+
+/* Compare two numbers with 'op': exactly if both are integers, as doubles otherwise. */
+#define NUMBER_COMPARE(a, b, op) \
+	(IS_INT(a) && IS_INT(b) ? AS_INT(a) op AS_INT(b) : AS_NUMBER(a) op AS_NUMBER(b))
+
 bool valuesEqual(Value a, Value b) {
+	if (IS_NUMBER(a) && IS_NUMBER(b)) return NUMBER_COMPARE(a, b, ==);
 	if (a.type != b.type) return false;
 	
 	switch(a.type) {
 		case VAL_BOOL: return AS_BOOL(a) == AS_BOOL(b);
 		case VAL_NULL: return true;
-		case VAL_NUMBER: return AS_NUMBER(a) == AS_NUMBER(b);
 		case VAL_OBJ: {
-			/*ObjString* aString = AS_STRING(a);
+			if (AS_OBJ(a) == AS_OBJ(b)) return true;
+			if (!IS_STRING(a) || !IS_STRING(b)) return false;
+			
+			// two interned strings are equal only if they're the same object. Ropes must have been flattened.
+			ObjString* aString = AS_STRING(a);
 			ObjString* bString = AS_STRING(b);
-			return aString->length == bString->length && memcmp(aString->chars, bString->chars, aString->length) == 0;*/
-			return AS_OBJ(a) == AS_OBJ(b);
+			if (aString->interned && bString->interned) return false;
+			return aString->length == bString->length && stringHash(aString) == stringHash(bString) && memcmp(aString->chars, bString->chars, aString->length) == 0;
 		}
 		default:
 			return false;
@@ -58,34 +130,50 @@ bool valuesEqual(Value a, Value b) {
 }
 
 bool valuesNotEqual(Value a, Value b) {
-	if (a.type != b.type) return false;
-	
-	switch(a.type) {
-		case VAL_BOOL: return AS_BOOL(a) != AS_BOOL(b);
-		case VAL_NULL: return false;
-		case VAL_NUMBER: return AS_NUMBER(a) != AS_NUMBER(b);
-		case VAL_OBJ: {
-			/*ObjString* aString = AS_STRING(a);
-			ObjString* bString = AS_STRING(b);
-			return aString->length != bString->length && memcmp(aString->chars, bString->chars, aString->length) != 0;*/
-			return AS_OBJ(a) == AS_OBJ(b);
+	return !valuesEqual(a, b);
+}
+
+/* Index of the first byte where a and b differ, or length if they don't. Compares 16 bytes per step with SSE2 where available. */
+static int firstDifference(const char* a, const char* b, int length) {
+	int i = 0;
+#ifdef __SSE2__
+	for (; i + 16 <= length; i += 16) {
+		__m128i aBlock = _mm_loadu_si128((const __m128i*)(a + i));
+		__m128i bBlock = _mm_loadu_si128((const __m128i*)(b + i));
+		unsigned int equal = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(aBlock, bBlock));
+		if (equal != 0xffff) {
+			return i + __builtin_ctz(~equal);
 		}
-		default:
-			return false;
 	}
+#endif
+	for (; i < length; i++) {
+		if (a[i] != b[i]) return i;
+	}
+	return length;
+}
+
+/* Lexicographic comparison of two flat strings, by unsigned byte value; a proper prefix orders first. Returns <0, 0 or >0. */
+int compareStrings(ObjString* a, ObjString* b) {
+	if (a == b) return 0;
+	
+	int shorter = a->length < b->length ? a->length : b->length;
+	int index = firstDifference(a->chars, b->chars, shorter);
+	if (index < shorter) {
+		return (int)(unsigned char)a->chars[index] - (int)(unsigned char)b->chars[index];
+	}
+	return a->length - b->length;
 }
 
 bool valuesGreater(Value a, Value b) {
+	if (IS_NUMBER(a) && IS_NUMBER(b)) return NUMBER_COMPARE(a, b, >);
 	if (a.type != b.type) return false;
 	
 	switch(a.type) {
 		case VAL_BOOL: return AS_BOOL(a) > AS_BOOL(b);
 		case VAL_NULL: return false;
-		case VAL_NUMBER: return AS_NUMBER(a) > AS_NUMBER(b);
 		case VAL_OBJ: {
-			ObjString* aString = AS_STRING(a);
-			ObjString* bString = AS_STRING(b);
-			return aString->length > bString->length && memcmp(aString->chars, bString->chars, aString->length) > 0;
+			if (!IS_STRING(a) || !IS_STRING(b)) return false;
+			return compareStrings(AS_STRING(a), AS_STRING(b)) > 0;
 		}
 		default:
 			return false;
@@ -93,16 +181,15 @@ bool valuesGreater(Value a, Value b) {
 }
 
 bool valuesGreaterEqual(Value a, Value b) {
+	if (IS_NUMBER(a) && IS_NUMBER(b)) return NUMBER_COMPARE(a, b, >=);
 	if (a.type != b.type) return false;
 	
 	switch(a.type) {
 		case VAL_BOOL: return AS_BOOL(a) >= AS_BOOL(b);
 		case VAL_NULL: return false;
-		case VAL_NUMBER: return AS_NUMBER(a) >= AS_NUMBER(b);
 		case VAL_OBJ: {
-			ObjString* aString = AS_STRING(a);
-			ObjString* bString = AS_STRING(b);
-			return aString->length >= bString->length && memcmp(aString->chars, bString->chars, aString->length) >= 0;
+			if (!IS_STRING(a) || !IS_STRING(b)) return false;
+			return compareStrings(AS_STRING(a), AS_STRING(b)) >= 0;
 		}
 		default:
 			return false;
@@ -110,16 +197,15 @@ bool valuesGreaterEqual(Value a, Value b) {
 }
 
 bool valuesLess(Value a, Value b) {
+	if (IS_NUMBER(a) && IS_NUMBER(b)) return NUMBER_COMPARE(a, b, <);
 	if (a.type != b.type) return false;
 	
 	switch(a.type) {
 		case VAL_BOOL: return AS_BOOL(a) < AS_BOOL(b);
 		case VAL_NULL: return false;
-		case VAL_NUMBER: return AS_NUMBER(a) < AS_NUMBER(b);
 		case VAL_OBJ: {
-			ObjString* aString = AS_STRING(a);
-			ObjString* bString = AS_STRING(b);
-			return aString->length < bString->length && memcmp(aString->chars, bString->chars, aString->length) < 0;
+			if (!IS_STRING(a) || !IS_STRING(b)) return false;
+			return compareStrings(AS_STRING(a), AS_STRING(b)) < 0;
 		}
 		default:
 			return false;
@@ -127,16 +213,15 @@ bool valuesLess(Value a, Value b) {
 }
 
 bool valuesLessEqual(Value a, Value b) {
+	if (IS_NUMBER(a) && IS_NUMBER(b)) return NUMBER_COMPARE(a, b, <=);
 	if (a.type != b.type) return false;
 	
 	switch(a.type) {
 		case VAL_BOOL: return AS_BOOL(a) <= AS_BOOL(b);
 		case VAL_NULL: return false;
-		case VAL_NUMBER: return AS_NUMBER(a) <= AS_NUMBER(b);
 		case VAL_OBJ: {
-			ObjString* aString = AS_STRING(a);
-			ObjString* bString = AS_STRING(b);
-			return aString->length <= bString->length && memcmp(aString->chars, bString->chars, aString->length) <= 0;
+			if (!IS_STRING(a) || !IS_STRING(b)) return false;
+			return compareStrings(AS_STRING(a), AS_STRING(b)) <= 0;
 		}
 		default:
 			return false;
@@ -9,6 +9,7 @@ typedef struct ObjString ObjString;
 typedef enum {
 	VAL_BOOL,
 	VAL_NULL,
+	VAL_INT,
 	VAL_NUMBER,
 	VAL_OBJ,
 	VAL_NL,
@@ -18,44 +19,63 @@ typedef struct {
 	ValueType type;
 	union {
 		bool boolean;
+		int64_t integer;
 		double number;
 		Obj* obj;
 	} as;
 	bool isConst;
 } Value;
 
+/* Numbers are either 64-bit integers (VAL_INT) or doubles (VAL_NUMBER). Integer literals and integer arithmetic stay integers as long as the result fits; anything else, and any mix with a double, gives a double. IS_NUMBER is true for both, and AS_NUMBER reads either as a double. */
+
 #define IS_BOOL(value)		((value).type == VAL_BOOL)
 #define IS_NULL(value)		((value).type == VAL_NULL)
-#define IS_NUMBER(value)	((value).type == VAL_NUMBER)
+#define IS_INT(value)		((value).type == VAL_INT)
+#define IS_DOUBLE(value)	((value).type == VAL_NUMBER)
+#define IS_NUMBER(value)	(IS_INT(value) || IS_DOUBLE(value))
 #define IS_OBJ(value)		((value).type == VAL_OBJ)
 #define IS_NL(value)		((value).type == VAL_NL)
 
 #define AS_OBJ(value)		((value).as.obj)
 #define AS_BOOL(value)		((value).as.boolean)
-#define AS_NUMBER(value)	((value).as.number)
+#define AS_INT(value)		((value).as.integer)
+#define AS_DOUBLE(value)	((value).as.number)
+#define AS_NUMBER(value)	numberToDouble(value)
 
 #define BOOL_VAL(value)		((Value){VAL_BOOL, {.boolean = value}})
 #define NULL_VAL         	((Value){VAL_NULL, {.number = 0}})
+#define INT_VAL(value)		((Value){VAL_INT, {.integer = value}})
 #define NUMBER_VAL(value)	((Value){VAL_NUMBER, {.number = value}})
 #define OBJ_VAL(object)		((Value){VAL_OBJ, {.obj = (Obj*)object}})
 #define NL_VAL			((Value){VAL_NL})
 
+static inline double numberToDouble(Value value) {
+	return IS_INT(value) ? (double)AS_INT(value) : AS_DOUBLE(value);
+}
+
 typedef struct {
 	int capacity;
 	int count;
 	Value* values;
 } ValueArray;
 
+// room valueText() needs for any value it formats.
+#define VALUE_TEXT_MAX 32
+
 bool valuesEqual(Value a, Value b);
 bool valuesNotEqual(Value a, Value b);
 bool valuesGreater(Value a, Value b);
 bool valuesGreaterEqual(Value a, Value b);
 bool valuesLess(Value a, Value b);
 bool valuesLessEqual(Value a, Value b);
+int compareStrings(ObjString* a, ObjString* b);
 Value valuesConditional(Value a, Value b, Value conditional);
 void initValueArray(ValueArray* array);
 void writeValueArray(ValueArray* array, Value value);
 void freeValueArray(ValueArray* array);
 void printValue(Value value);
+int formatInteger(int64_t integer, char* buffer);
+int formatNumber(double number, char* buffer);
+int valueText(Value value, char* buffer);
 
 #endif
@@ -1,3 +1,5 @@
+#include <math.h>
+#include <setjmp.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,6 +11,7 @@
 #include "debug.h"
 #include "object.h"
 #include "memory.h"
+#include "native.h"
 #include "value.h"
 #include "vm.h"
 
@@ -18,13 +21,17 @@ VM vm;
 bool switchFallThrough = false;
 
 static void resetStack() {
-	initStack(&vm.stack);
+	// Reuse the stack once it exists: resetting must not allocate, the heap may be full (see outOfMemory()).
+	if (vm.stack.stack == NULL) {
+		initStack(&vm.stack, STACK_MAX);
+	}
+	vm.stack.count = 0;
 	vm.stackTop = vm.stack.stack;
 	vm.frameCount = 0;
 	vm.openUpvalues = NULL;
 }
 
-static void runtimeError(const char* format, ...) {
+void runtimeError(const char* format, ...) {
 	va_list args;
 	va_start(args, format);
 	vfprintf(stderr, format, args);
@@ -47,54 +54,71 @@ static void runtimeError(const char* format, ...) {
 	resetStack();
 }
 
-static Value clockNative(int argCount, Value* args) {
-	if (argCount != 0) {
-		runtimeError("\e[1;31mError: 'clock' function call expected 0 argument(s). Initialized with %d argument(s) instead, ", argCount);
-		return NULL_VAL;
+/* OLIVE_HASH_SEED fixes the string hash seed (to reproduce a run), otherwise it's mixed from the clock and the address space layout. */
+static uint64_t pickHashSeed() {
+	const char* seed = getenv("OLIVE_HASH_SEED");
+	if (seed != NULL) {
+		return strtoull(seed, NULL, 0);
 	}
 	
-	return NUMBER_VAL((double)clock() / CLOCKS_PER_SEC);
-}
-
-static void defineNative(const char* name, NativeFunction function) {
-	Value functionName = OBJ_VAL(allocateString(false, name, (int)strlen(name)));
-	Value functionCall = OBJ_VAL(newNative(function));
-	push(functionName);
-	push(functionCall);
-	tableSet(&vm.globals, &OBJ_KEY(AS_STRING(vm.stack.stack[0])), vm.stack.stack[1]);
-	pop(2);
-	vm.nativeIdentifiers[vm.nativeIdentifierCount++] = name;
+	return ((uint64_t)time(NULL) * 0x9e3779b97f4a7c15ull) ^ (uint64_t)(uintptr_t)&vm ^ (uint64_t)clock();
 }
 
 void initVM() {
+	vm.hashSeed = pickHashSeed();
 	resetStack();
 	vm.objects = NULL;
 	
 	vm.bytesAllocated = 0;
 	vm.nextGC = 1024 * 1024;
+	vm.heapGrowFactor = 2;
+	vm.minCollectInterval = 0;
+	vm.maxHeap = 0;
+	vm.logGC = false;
+	vm.errorHandler = NULL;
+	vm.gcStats.collections = 0;
+	vm.gcStats.pauseTime = 0;
+	vm.gcStats.bytesFreed = 0;
+	vm.gcStats.peakHeap = 0;
+	vm.sweepPrevious = NULL;
+	vm.bytesSwept = 0;
+	vm.bytesFreedSinceCompact = 0;
+	vm.compactPending = false;
 	
 	vm.grayCount = 0;
 	vm.grayCapacity = 0;
 	vm.grayStack = NULL;
+	vm.viewCount = 0;
+	vm.viewCapacity = 0;
+	vm.viewStack = NULL;
 	
 	initTable(&vm.globals);
 	
 	initTable(&vm.strings);
 	vm.initString = NULL;
 	vm.initString = allocateString(false, "init", 4);
+	for (int i = 0; i <= UINT8_MAX; i++) {
+		vm.charStrings[i] = NULL;
+	}
 	
 	initTable(&vm.globalConstantIndex);
+	initTable(&vm.nativeConstantIndex);
+	initTable(&vm.selectors);
+	vm.selectorCount = 0;
 	
-	vm.nativeIdentifierCount = 0;
-	
-	defineNative("clock", clockNative);
+	initNatives();
 }
 
 void freeVM(bool REPLmode) {
 	freeTable(&vm.globals);
 	freeTable(&vm.globalConstantIndex);
+	freeTable(&vm.nativeConstantIndex);
+	freeTable(&vm.selectors);
 	freeTable(&vm.strings);
 	vm.initString = NULL;
+	for (int i = 0; i <= UINT8_MAX; i++) {
+		vm.charStrings[i] = NULL;
+	}
 	if (REPLmode && vm.frameCount > 0) {
 		freeValueArray(vm.frames[0].closure->function->chunk.constants);
 	}
@@ -102,11 +126,33 @@ void freeVM(bool REPLmode) {
 	freeObjects();
 }
 
+/* Raise a runtime error from where there is no result to return it through. Control returns to interpret(), which hands INTERPRET_RUNTIME_ERROR to the host instead of killing the process. Outside of interpret() there is nothing to unwind to. */
+static void unwind(const char* message) {
+	jmp_buf* handler = vm.errorHandler;
+	vm.errorHandler = NULL;
+	
+	if (handler == NULL) {
+		fprintf(stderr, "\e[1;31mError: %s.\n\e[0m", message);
+		exit(1);
+	}
+	
+	if (vm.frameCount == 0) {
+		fprintf(stderr, "\e[1;31mError: %s.\n\e[0m", message);
+		resetStack();
+	} else {
+		runtimeError("\e[1;31mError: %s, ", message);
+	}
+	longjmp(*handler, 1);
+}
+
+void outOfMemory() {
+	unwind("Out of memory");
+}
+
+/* The stack doesn't grow, so a Value* into it held across an allocation stays valid. Overflowing it is a runtime error. */
 void push(Value value) {
-	if(vm.stack.capacity <  vm.stack.count + 1) {
-		int temp = vm.stackTop - vm.stack.stack;
-		growStack(&vm.stack);
-		vm.stackTop = vm.stack.stack + temp;
+	if (vm.stack.count == vm.stack.capacity) {
+		unwind("Stack overflow");
 	}
 	
 	*vm.stackTop = value;
@@ -178,11 +224,13 @@ static bool callValue(Value callee, int argCount) {
 			case OBJ_NATIVE: {
 				NativeFunction native = AS_NATIVE(callee);
 				Value result = native(argCount, vm.stackTop - argCount);
-				if (IS_NULL(result)) {
+				// runtimeError() resets the frames, which tells a failed native from one returning null.
+				if (IS_NULL(result) && vm.frameCount == 0) {
 					return false;
 				}
 				
 				vm.stackTop -= argCount + 1;
+				vm.stack.count -= argCount + 1;
 				push(result);
 				return true;
 			}	
@@ -197,17 +245,37 @@ static bool callValue(Value callee, int argCount) {
 	return false;
 }
 
-static bool invokeFromClass(ObjClass* c, ObjString* name, int argCount) {
-	Value method;
-	if (!tableGet(&c->methods, &OBJ_KEY(name), &method)) {
+/* The selector of a method name. Every name a class defines or a call site invokes gets one while compiling, so method lookup at runtime is an index into the class' vtable. Returns -1 once the selectors run out. */
+int methodSelector(ObjString* name) {
+	Value selector;
+	if (tableGet(&vm.selectors, &OBJ_KEY(name), &selector)) {
+		return (int)AS_NUMBER(selector);
+	}
+	
+	if (vm.selectorCount == SELECTOR_MAX) return -1;
+	tableSet(&vm.selectors, &OBJ_KEY(name), NUMBER_VAL(vm.selectorCount));
+	return vm.selectorCount++;
+}
+
+static bool invokeFromClass(ObjClass* c, ObjString* name, int selector, int argCount) {
+	ObjClosure* method = NULL;
+	if (c->vtable != NULL) {
+		int slot = selector - c->vtableBase;
+		if (slot >= 0 && slot < c->vtableCount) method = c->vtable[slot];
+	} else {
+		// no vtable, see buildVTable().
+		Value value;
+		if (tableGet(&c->methods, &OBJ_KEY(name), &value)) method = AS_CLOSURE(value);
+	}
+	
+	if (method == NULL) {
 		runtimeError("\e[1;31mUndefined property '%.*s', ", name->length, name->chars);
 		return false;
 	}
-	
-	return call(AS_CLOSURE(method), argCount);
+	return call(method, argCount);
 }
 
-static bool invoke(ObjString* name, int argCount) {
+static bool invoke(ObjString* name, int selector, int argCount) {
 	Value reciever = peek(argCount);
 	
 	if (!IS_INSTANCE(reciever)) {
@@ -223,7 +291,7 @@ static bool invoke(ObjString* name, int argCount) {
 		return callValue(value, argCount);
 	}
 	
-	return invokeFromClass(instance->c, name, argCount);
+	return invokeFromClass(instance->c, name, selector, argCount);
 }
 
 static bool bindMethod(ObjClass* c, ObjString* name) {
@@ -285,6 +353,46 @@ static void defineMethod(ObjString* name) {
 	pop(1);
 }
 
+/* Flatten the class' methods, inherited ones included, into an array indexed by selector, covering only the range of selectors the class uses. Classes can't change once their body is closed, so this happens once per class. */
+static void buildVTable(ObjClass* c) {
+	int methodCount = 0;
+	int low = SELECTOR_MAX;
+	int high = -1;
+	for (int i = 0; i <= c->methods.capacity; i++) {
+		Entry* entry = &c->methods.entries[i];
+		if (IS_NULL(entry->key)) continue;
+		
+		// every method name got its selector when the class was compiled.
+		int selector = methodSelector(AS_STRING(entry->key));
+		if (selector < low) low = selector;
+		if (selector > high) high = selector;
+		methodCount++;
+	}
+	
+	// selectors are shared by the whole program, so a few methods can span a wide range. A mostly empty table isn't worth its memory: such a class is looked up in 'methods' instead.
+	int count = high - low + 1;
+	if (methodCount == 0 || count > 4 * methodCount + 16) {
+		c->vtable = NULL;
+		c->vtableCount = 0;
+	} else {
+		c->vtable = ALLOCATE(ObjClosure*, count);
+		c->vtableBase = low;
+		c->vtableCount = count;
+		memset(c->vtable, 0, sizeof(ObjClosure*) * count);
+		for (int i = 0; i <= c->methods.capacity; i++) {
+			Entry* entry = &c->methods.entries[i];
+			if (IS_NULL(entry->key)) continue;
+			
+			c->vtable[methodSelector(AS_STRING(entry->key)) - low] = AS_CLOSURE(entry->value);
+		}
+	}
+	
+	// an inherited initializer.
+	if (IS_NULL(c->initCall)) {
+		tableGet(&c->methods, &OBJ_KEY(vm.initString), &c->initCall);
+	}
+}
+
 static bool isFalsey(Value value) {
 	return IS_NULL(value) || (IS_BOOL(value) && !AS_BOOL(value));
 }
@@ -293,141 +401,310 @@ static bool isFalsey(Value value) {
 	return IS_NULL(value) || (IS_BOOL(value) && AS_BOOL(value));
 }*/
 
+/* Replace a rope on the stack by its flat string, for operations that need the characters. */
+static void flattenSlot(Value* slot) {
+	if (IS_STRING(*slot) && IS_ROPE(AS_STRING(*slot))) {
+		slot->as.obj = (Obj*)flattenString(AS_STRING(*slot));
+	}
+}
+
+static void flattenOperands() {
+	flattenSlot(vm.stackTop - 1);
+	flattenSlot(vm.stackTop - 2);
+}
+
 static void concatenate() {
 	ObjString* b = AS_STRING(peek(0));
 	ObjString* a = AS_STRING(peek(1));
 	
 	int length = a->length + b->length;
-	char* chars = ALLOCATE(char, length + 1);
-	memcpy(chars, a->chars, a->length);
-	memcpy(chars + a->length, b->chars, b->length);
+	ObjString* result;
+	if (length >= ROPE_MIN_LENGTH) {
+		result = newRope(a, b);
+	} else {
+		// short strings are never ropes.
+		result = makeString(length);
+		memcpy(result->inlineChars, a->chars, a->length);
+		memcpy(result->inlineChars + a->length, b->chars, b->length);
+	}
 	
-	ObjString* result = takeString(chars, length);
 	pop(2);
 	push(OBJ_VAL(result));
 }
 
+/* Replace a non-string operand of '+' on the stack by its string form. */
+static bool stringifySlot(Value* slot) {
+	if (IS_STRING(*slot)) return true;
+	
+	char buffer[VALUE_TEXT_MAX];
+	int length = valueText(*slot, buffer);
+	if (length < 0) return false;
+	
+	*slot = OBJ_VAL(copyString(buffer, length));
+	return true;
+}
+
+/* '+' with a string and a non-string operand: convert the other operand and concatenate, so growing a string with numbers and newlines stays a rope. */
 static bool convconcatenate() {
-	Value a = peek(0);
-	Value b = peek(1);
+	if (!stringifySlot(vm.stackTop - 1) || !stringifySlot(vm.stackTop - 2)) {
+		runtimeError("\e[1;31mError: Invalid operands for string conversion. ");
+		return false;
+	}
 	
-	int length = 0;
-	char* result = ALLOCATE(char, 1024); // not a great use of memory, sigh, I know
+	concatenate();
+	return true;
+}
+
+/* The number of elements of an indexable sequence: a list or a Float64Array. */
+static bool sequenceLength(Value container, int* count) {
+	if (IS_LIST(container)) {
+		*count = AS_LIST(container)->items.count;
+	} else if (IS_FLOAT64_ARRAY(container)) {
+		*count = AS_FLOAT64_ARRAY(container)->count;
+	} else {
+		runtimeError("\e[1;31mError: Only lists, maps and Float64Arrays can be indexed, ");
+		return false;
+	}
+	return true;
+}
+
+/* The element 'index' refers to in a sequence of 'count' values. Negative indices count from the end. */
+static bool listIndex(Value index, int count, int* slot) {
+	if (!IS_NUMBER(index) || AS_NUMBER(index) != trunc(AS_NUMBER(index))) {
+		runtimeError("\e[1;31mError: Index must be an integer, ");
+		return false;
+	}
 	
-	if (result == NULL) {
-		runtimeError("\e[1;31mError: Unexpected memory allocation error. ");
+	// as a double, so indices past the int range are only out of range.
+	double i = AS_NUMBER(index);
+	if (i < 0) i += count;
+	if (i < 0 || i >= count) {
+		runtimeError("\e[1;31mError: Index %g out of range for a sequence of %d element(s), ", AS_NUMBER(index), count);
+		return false;
 	}
 	
-	switch(b.type) {
-		case VAL_BOOL: {
-			bool bl = AS_BOOL(b);
-			if (bl == true) {
-				memcpy(result+length, "true", 4);
-				length += 4;
-			} else {
-				memcpy(result+length, "false", 5);
-				length += 5;
-			}
-			break;
+	*slot = (int)i;
+	return true;
+}
+
+/* whether 'value' comes before 'end' going by 'step'. */
+static inline bool inRange(Value value, Value end, Value step) {
+	if (IS_INT(value) && IS_INT(end) && IS_INT(step)) {
+		return AS_INT(step) > 0 ? AS_INT(value) < AS_INT(end) : AS_INT(value) > AS_INT(end);
+	}
+	return AS_NUMBER(step) > 0 ? AS_NUMBER(value) < AS_NUMBER(end) : AS_NUMBER(value) > AS_NUMBER(end);
+}
+
+/* 'value' advanced by 'step', staying an integer unless it overflows. */
+static inline Value stepValue(Value value, Value step) {
+	int64_t result;
+	if (IS_INT(value) && IS_INT(step) && !__builtin_add_overflow(AS_INT(value), AS_INT(step), &result)) {
+		return INT_VAL(result);
+	}
+	return NUMBER_VAL(AS_NUMBER(value) + AS_NUMBER(step));
+}
+
+/* OP_FOR_PREP: complete the range() arguments of a counted loop to a counter, an end and a step, and push the loop variable. Returns false on bad arguments. */
+static bool forPrep(CallFrame* frame, int slot, int argCount) {
+	while (vm.stackTop < frame->slots + slot + 4) {
+		push(NULL_VAL);
+	}
+	
+	Value* counter = frame->slots + slot;
+	for (int i = 0; i < argCount; i++) {
+		if (!IS_NUMBER(counter[i])) {
+			runtimeError("\e[1;31mError: 'range' expects 1 to 3 numbers, ");
+			return false;
 		}
-		
-		case VAL_NULL: {
-			memcpy(result+length, "NULL", 4);
-			length += 4;
+	}
+	
+	if (argCount == 1) {
+		counter[1] = counter[0];
+		counter[0] = INT_VAL(0);
+	}
+	if (argCount < 3) {
+		counter[2] = INT_VAL(1);
+	}
+	if (AS_NUMBER(counter[2]) == 0) {
+		runtimeError("\e[1;31mError: 'range' step can't be 0, ");
+		return false;
+	}
+	
+	counter[3] = counter[0];
+	return true;
+}
+
+/* What OP_ITER_NEXT found: the next element, the end of the sequence, or an instance, which iterates through its own methods. */
+typedef enum {
+	ITER_ELEMENT,
+	ITER_DONE,
+	ITER_METHODS,
+	ITER_ERROR,
+} IterStep;
+
+/* Bytes in the UTF-8 character at 'chars', at most 'length', or 1 for a malformed or truncated sequence. */
+static int utf8Width(const char* chars, int length) {
+	uint8_t lead = (uint8_t)chars[0];
+	int width = lead < 0xC0 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : lead < 0xF8 ? 4 : 1;
+	if (width > length) return 1;
+	for (int i = 1; i < width; i++) {
+		if (((uint8_t)chars[i] & 0xC0) != 0x80) return 1;
+	}
+	return width;
+}
+
+/* Step the for-in loop whose hidden locals start at 'slot' in the current frame: the sequence, the state (null before the first element, then the position of the next one) and the loop variable, which gets the element. Strings are walked by UTF-8 character, and nothing is allocated but the first interned string for each character met. */
+static IterStep iterNext(CallFrame* frame, int slot) {
+	Value* sequence = frame->slots + slot;
+	if (!IS_OBJ(sequence[0])) {
+		runtimeError("\e[1;31mError: Can only iterate over lists, maps, strings, Float64Arrays and instances, ");
+		return ITER_ERROR;
+	}
+	
+	if (IS_RANGE(sequence[0])) {
+		// the state is the next value itself.
+		ObjRange* range = AS_RANGE(sequence[0]);
+		Value value = IS_NULL(sequence[1]) ? range->start : sequence[1];
+		if (!inRange(value, range->end, range->step)) return ITER_DONE;
+		sequence[2] = value;
+		sequence[1] = stepValue(value, range->step);
+		return ITER_ELEMENT;
+	}
+	
+	int index = IS_NULL(sequence[1]) ? 0 : (int)AS_INT(sequence[1]);
+	switch (OBJ_TYPE(sequence[0])) {
+		case OBJ_LIST: {
+			ValueArray* items = &AS_LIST(sequence[0])->items;
+			if (index >= items->count) return ITER_DONE;
+			sequence[2] = items->values[index];
 			break;
 		}
-		
-		case VAL_NUMBER: {
-			long long int len = snprintf(NULL, 0, "%g", AS_NUMBER(b));
-			char* str = ALLOCATE(char, len + 1);
-			snprintf(str, len + 1, "%g", AS_NUMBER(b));
-			memcpy(result + length, str, len);	
-			length += len;
-			FREE(char, str);		
-			break;		
-		}
-		
-		case VAL_OBJ: {
-			if(!IS_STRING(b)) {
-				runtimeError("\e[1;31mError: Invalid operands for string conversion. ");
-			}
-			
-			ObjString* str = AS_STRING(b);
-			memcpy(result + length, str->chars, str->length);
-			length += str->length;
+		case OBJ_FLOAT64_ARRAY: {
+			ObjFloat64Array* array = AS_FLOAT64_ARRAY(sequence[0]);
+			if (index >= array->count) return ITER_DONE;
+			sequence[2] = NUMBER_VAL(array->data[index]);
 			break;
 		}
-		
-		case VAL_NL: {
-			memcpy(result + length, "\n", 1);
-			length += 1;
+		case OBJ_MAP: {
+			// the state is a slot of the table, so a for-in over a map visits its keys in table order.
+			Table* table = &AS_MAP(sequence[0])->table;
+			while (index <= table->capacity && IS_NULL(table->entries[index].key)) index++;
+			if (index > table->capacity) return ITER_DONE;
+			sequence[2] = keyToValue(&table->entries[index].key);
 			break;
 		}
-		
-		default: {
-			runtimeError("\e[1;31mError: Invalid operands for string conversion. ");
-			return false;
-		}
+		case OBJ_STRING: {
+			flattenSlot(sequence);
+			ObjString* string = AS_STRING(sequence[0]);
+			if (index >= string->length) return ITER_DONE;
+			const char* character = string->chars + index;
+			int width = utf8Width(character, string->length - index);
 			
-	}
-	
-	switch(a.type) {
-		case VAL_BOOL: {
-			bool bl = AS_BOOL(a);
-			if (bl == true) {
-				memcpy(result+length, "true", 4);
-				length += 4;
+			ObjString* element;
+			if (width == 1) {
+				uint8_t c = (uint8_t)character[0];
+				if (vm.charStrings[c] == NULL) {
+					vm.charStrings[c] = allocateString(true, character, 1);
+				}
+				element = vm.charStrings[c];
 			} else {
-				memcpy(result+length, "false", 5);
-				length += 5;
+				element = allocateString(true, character, width);
 			}
-			break;
+			sequence[2] = OBJ_VAL(element);
+			sequence[1] = INT_VAL(index + width);
+			return ITER_ELEMENT;
 		}
-		
-		case VAL_NULL: {
-			memcpy(result+length, "NULL", 4);
-			length += 4;
-			break;
-		}
-		
-		case VAL_NUMBER: {
-			long long int len = snprintf(NULL, 0, "%g", AS_NUMBER(a));
-			char* str = ALLOCATE(char, len + 1);
-			snprintf(str, len + 1, "%g", AS_NUMBER(a));
-			memcpy(result + length, str, len);	
-			length += len;
-			FREE(char, str);
-			break;		
-		}
-		
-		case VAL_OBJ: {
-			if(!IS_STRING(a)) {
-				runtimeError("\e[1;31mError: Invalid operands for string conversion");
-			}
-			ObjString* str = AS_STRING(a);
-			memcpy(result + length, str->chars, str->length);
-			length += str->length;
-			break;
+		case OBJ_INSTANCE:
+			return ITER_METHODS;
+		default:
+			runtimeError("\e[1;31mError: Can only iterate over lists, maps, strings, Float64Arrays and instances, ");
+			return ITER_ERROR;
+	}
+	
+	sequence[1] = INT_VAL(index + 1);
+	return ITER_ELEMENT;
+}
+
+/* OP_BUILD_LIST: gather the 'count' values on top of the stack into a new list. */
+static void buildList(int count) {
+	ObjList* list = newList();
+	push(OBJ_VAL(list));
+	
+	Value* items = vm.stackTop - count - 1;
+	for (int i = 0; i < count; i++) {
+		writeValueArray(&list->items, items[i]);
+	}
+	
+	vm.stackTop -= count + 1;
+	vm.stack.count -= count + 1;
+	push(OBJ_VAL(list));
+}
+
+/* OP_BUILD_MAP: gather the 'count' key/value pairs on top of the stack into a new map. A repeated key keeps its last value. */
+static bool buildMap(int count) {
+	ObjMap* map = newMap();
+	push(OBJ_VAL(map));
+	
+	Value* pairs = vm.stackTop - 2 * count - 1;
+	for (int i = 0; i < count; i++) {
+		Key key;
+		if (!valueToKey(&pairs[2 * i], &key)) {
+			runtimeError("\e[1;31mError: Map keys must be numbers, strings or booleans, ");
+			return false;
 		}
-		
-		case VAL_NL: {
-			memcpy(result + length, "\n", 1);
-			length += 1;
-			break;
+		tableSet(&map->table, &key, pairs[2 * i + 1]);
+	}
+	
+	vm.stackTop -= 2 * count + 1;
+	vm.stack.count -= 2 * count + 1;
+	push(OBJ_VAL(map));
+	return true;
+}
+
+/* Join the top 'count' stack values into one string, converting non-strings the way '+' does. The result is sized up front and written once. */
+static bool buildString(int count) {
+	static char texts[UINT8_MAX + 1][VALUE_TEXT_MAX];
+	Value* pieces = vm.stackTop - count;
+	
+	if (count == 1 && IS_STRING(pieces[0])) {
+		return true;
+	}
+	
+	int length = 0;
+	for (int i = 0; i < count; i++) {
+		if (IS_STRING(pieces[i])) {
+			length += AS_STRING(pieces[i])->length;
+			continue;
 		}
 		
-		default: {
-			runtimeError("\e[1;31mError: Invalid operands for string conversion.");
+		int textLength = valueText(pieces[i], texts[i]);
+		if (textLength < 0) {
+			runtimeError("\e[1;31mError: Invalid operands for string conversion. ");
 			return false;
 		}
-			
+		length += textLength;
 	}
 	
-
-	result[length] = '\0';
-	ObjString* output = takeString(result, length);
-	pop(2);
-	push(OBJ_VAL(output));	
+	ObjString* result = makeString(length);
+	push(OBJ_VAL(result));
+	pieces = vm.stackTop - 1 - count;
+	
+	char* chars = result->inlineChars;
+	int offset = 0;
+	for (int i = 0; i < count; i++) {
+		if (IS_STRING(pieces[i])) {
+			ObjString* string = AS_STRING(pieces[i]);
+			copyStringChars(string, chars + offset);
+			offset += string->length;
+		} else {
+			int textLength = (int)strlen(texts[i]);
+			memcpy(chars + offset, texts[i], textLength);
+			offset += textLength;
+		}
+	}
+	vm.stackTop -= count + 1;
+	vm.stack.count -= count + 1;
+	push(OBJ_VAL(result));
 	return true;
 }
 
@@ -449,17 +726,52 @@ static bool percentOf() {
 	return true;
 }
 
+/* 'mod' and 'div': the remainder and the quotient of a division rounded toward zero, so a == (a div b) * b + a mod b. Exact on two integers; otherwise 'mod' is fmod() and 'div' the rounded double quotient. */
+static bool truncatedDivision(bool remainder) {
+	Value b = peek(0);
+	Value a = peek(1);
+	if (!IS_NUMBER(a) || !IS_NUMBER(b)) {
+		runtimeError("\e[1;31mError: Operands must be numbers.");
+		return false;
+	}
+	
+	Value result;
+	if (IS_INT(a) && IS_INT(b)) {
+		int64_t x = AS_INT(a);
+		int64_t y = AS_INT(b);
+		if (y == 0) {
+			runtimeError("\e[1;31mError: Integer division by zero, ");
+			return false;
+		}
+		if (y == -1) {
+			// INT64_MIN / -1 overflows, and INT64_MIN % -1 traps.
+			result = remainder ? INT_VAL(0) : (x == INT64_MIN ? NUMBER_VAL(-(double)x) : INT_VAL(-x));
+		} else {
+			result = remainder ? INT_VAL(x % y) : INT_VAL(x / y);
+		}
+	} else {
+		double x = AS_NUMBER(a);
+		double y = AS_NUMBER(b);
+		result = NUMBER_VAL(remainder ? fmod(x, y) : trunc(x / y));
+	}
+	
+	pop(1);
+	vm.stackTop[-1] = result;
+	return true;
+}
+
 static InterpretResult run(bool REPLmode) {
 	CallFrame* frame = &vm.frames[vm.frameCount - 1];
 
 #define READ_BYTE() (*frame->ip++)
 #define READ_CONSTANT() (frame->closure->function->chunk.constants->values[READ_BYTE()])
-#define READ_LONG_CONSTANT() (frame->closure->function->chunk.constants->values[frame->closure->function->chunk.code[(int)(frame->ip - frame->closure->function->chunk.code)+1] |\
-			      frame->closure->function->chunk.code[(int)(frame->ip - frame->closure->function->chunk.code)+2] << 8 |\
-			      frame->closure->function->chunk.code[(int)(frame->ip - frame->closure->function->chunk.code)+3] << 16])
+#define READ_LONG_CONSTANT() \
+	(frame->ip += 3, frame->closure->function->chunk.constants->values[frame->ip[-3] | frame->ip[-2] << 8 | frame->ip[-1] << 16])
+// the constant operand of an instruction that has a 3 byte '_LONG' variant.
+#define READ_OPERAND(longOp) (instruction == (longOp) ? READ_LONG_CONSTANT() : READ_CONSTANT())
 #define READ_SHORT() \
 	(frame->ip += 2, (uint16_t)((frame->ip[-2] << 8) | frame->ip[-1]))
-#define READ_STRING() AS_STRING(READ_CONSTANT())
+#define READ_STRING(longOp) AS_STRING(READ_OPERAND(longOp))
 
 #define BINARY_OP(valueType, op)\
 	do { \
@@ -469,18 +781,21 @@ static InterpretResult run(bool REPLmode) {
 		}\
 		double b = AS_NUMBER(pop(1)); \
 		Value* stackTop = vm.stackTop - 1; \
-		AS_NUMBER(*stackTop) = AS_NUMBER(*stackTop) op b; \
+		*stackTop = valueType(AS_NUMBER(*stackTop) op b); \
 	} while (false)
 
-#define MOD_OP(valueType, op)\
+// two integers whose result fits stay integers, anything else is done in doubles.
+#define INTEGER_OP(op, checkedOp)\
 	do { \
-		if(!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) {\
-			runtimeError("\e[1;31mError: Operands must be numbers."); \
-			return INTERPRET_RUNTIME_ERROR; \
-		}\
-		int b = AS_NUMBER(pop(1)); \
-		Value* stackTop = vm.stackTop - 1; \
-		AS_NUMBER(*stackTop) = ((int)AS_NUMBER(*stackTop)) op b; \
+		Value* left = vm.stackTop - 2; \
+		Value right = vm.stackTop[-1]; \
+		int64_t result; \
+		if (IS_INT(*left) && IS_INT(right) && !checkedOp(AS_INT(*left), AS_INT(right), &result)) { \
+			*left = INT_VAL(result); \
+			pop(1); \
+			break; \
+		} \
+		BINARY_OP(NUMBER_VAL, op); \
 	} while (false)
 
 	for (;;) {
@@ -535,8 +850,9 @@ static InterpretResult run(bool REPLmode) {
 				break;
 			}
 			
-			case OP_GET_GLOBAL: {
-				ObjString* name = READ_STRING();
+			case OP_GET_GLOBAL:
+			case OP_GET_GLOBAL_LONG: {
+				ObjString* name = READ_STRING(OP_GET_GLOBAL_LONG);
 				Value value;
 				if (!tableGet(&vm.globals, &OBJ_KEY(name), &value)) {
 					runtimeError("\e[1;31mError: Undefined variable '%.*s', ", name->length, name->chars);
@@ -546,15 +862,17 @@ static InterpretResult run(bool REPLmode) {
 				break;
 			}
 			
-			case OP_DEFINE_GLOBAL: {
-				ObjString* name = READ_STRING();
+			case OP_DEFINE_GLOBAL:
+			case OP_DEFINE_GLOBAL_LONG: {
+				ObjString* name = READ_STRING(OP_DEFINE_GLOBAL_LONG);
 				tableSet(&vm.globals, &OBJ_KEY(name), peek(0));
 				pop(1);
 				break;
 			}
 			
-			case OP_SET_GLOBAL:{
-				ObjString* name = READ_STRING();
+			case OP_SET_GLOBAL:
+			case OP_SET_GLOBAL_LONG: {
+				ObjString* name = READ_STRING(OP_SET_GLOBAL_LONG);
 				if (tableSet(&vm.globals, &OBJ_KEY(name), peek(0))) {
 					tableDelete(&vm.globals, &OBJ_KEY(name));
 					runtimeError("\e[1;31mError: Undefined variable '%.*s', ", name->length, name->chars);
@@ -575,13 +893,14 @@ static InterpretResult run(bool REPLmode) {
 				break;
 			}
 			
-			case OP_GET_PROPERTY: {
+			case OP_GET_PROPERTY:
+			case OP_GET_PROPERTY_LONG: {
 				if (!IS_INSTANCE(peek(0))) {
 					runtimeError("\e[1;31mError: Attempt to access property of a non-instance, ");
 					return INTERPRET_RUNTIME_ERROR;
 				}
 				ObjInstance* instance = AS_INSTANCE(peek(0));
-				ObjString* name = READ_STRING();
+				ObjString* name = READ_STRING(OP_GET_PROPERTY_LONG);
 				
 				Value value;
 				if (tableGet(&instance->fields, &OBJ_KEY(name), &value)) {
@@ -597,13 +916,14 @@ static InterpretResult run(bool REPLmode) {
 				break;
 			}
 			
-			case OP_SET_PROPERTY: {
+			case OP_SET_PROPERTY:
+			case OP_SET_PROPERTY_LONG: {
 				if (!IS_INSTANCE(peek(1))) {
 					runtimeError("\e[1;31mError: Only instances have fields, ");
 					return INTERPRET_RUNTIME_ERROR;
 				}
 				ObjInstance* instance = AS_INSTANCE(peek(1));
-				tableSet(&instance->fields, &OBJ_KEY(READ_STRING()), peek(0));
+				tableSet(&instance->fields, &OBJ_KEY(READ_STRING(OP_SET_PROPERTY_LONG)), peek(0));
 				
 				Value value = pop(1);
 				pop(1);
@@ -611,8 +931,94 @@ static InterpretResult run(bool REPLmode) {
 				break;
 			}
 			
+			case OP_INDEX_GET: {
+				Value index = peek(0);
+				Value container = peek(1);
+				if (IS_MAP(container)) {
+					Key key;
+					Value value;
+					if (!valueToKey(vm.stackTop - 1, &key)) {
+						runtimeError("\e[1;31mError: Map keys must be numbers, strings or booleans, ");
+						return INTERPRET_RUNTIME_ERROR;
+					}
+					if (!tableGet(&AS_MAP(peek(1))->table, &key, &value)) {
+						runtimeError("\e[1;31mError: Key not found in map, ");
+						return INTERPRET_RUNTIME_ERROR;
+					}
+					
+					pop(1);
+					vm.stackTop[-1] = value;
+					break;
+				}
+				
+				int count;
+				if (!sequenceLength(container, &count)) {
+					return INTERPRET_RUNTIME_ERROR;
+				}
+				
+				int slot;
+				// the common case: an integer within bounds.
+				if (IS_INT(index) && (uint64_t)AS_INT(index) < (uint64_t)count) {
+					slot = (int)AS_INT(index);
+				} else if (!listIndex(index, count, &slot)) {
+					return INTERPRET_RUNTIME_ERROR;
+				}
+				
+				pop(1);
+				vm.stackTop[-1] = IS_LIST(container) ? AS_LIST(container)->items.values[slot] : NUMBER_VAL(AS_FLOAT64_ARRAY(container)->data[slot]);
+				break;
+			}
+			
+			case OP_INDEX_SET: {
+				Value index = peek(1);
+				Value container = peek(2);
+				if (IS_MAP(container)) {
+					Key key;
+					if (!valueToKey(vm.stackTop - 2, &key)) {
+						runtimeError("\e[1;31mError: Map keys must be numbers, strings or booleans, ");
+						return INTERPRET_RUNTIME_ERROR;
+					}
+					tableSet(&AS_MAP(peek(2))->table, &key, peek(0));
+					
+					Value value = pop(1);
+					pop(1);
+					vm.stackTop[-1] = value;
+					break;
+				}
+				
+				int count;
+				if (!sequenceLength(container, &count)) {
+					return INTERPRET_RUNTIME_ERROR;
+				}
+				
+				int slot;
+				if (IS_INT(index) && (uint64_t)AS_INT(index) < (uint64_t)count) {
+					slot = (int)AS_INT(index);
+				} else if (!listIndex(index, count, &slot)) {
+					return INTERPRET_RUNTIME_ERROR;
+				}
+				
+				// the assignment's value is what's left on the stack.
+				Value value = peek(0);
+				if (IS_LIST(container)) {
+					AS_LIST(container)->items.values[slot] = value;
+				} else if (IS_NUMBER(value)) {
+					AS_FLOAT64_ARRAY(container)->data[slot] = AS_NUMBER(value);
+				} else {
+					runtimeError("\e[1;31mError: Float64Array elements must be numbers, ");
+					return INTERPRET_RUNTIME_ERROR;
+				}
+				
+				pop(1);
+				pop(1);
+				vm.stackTop[-1] = value;
+				break;
+			}
+			
 			case OP_DELATTR: {
-				ObjString* attr = AS_STRING(pop(1));
+				flattenSlot(vm.stackTop - 1);
+				ObjString* attr = internString(AS_STRING(peek(0)));
+				pop(1);
 				ObjInstance* instance = AS_INSTANCE(pop(1));
 				Value value;
 				if (tableGet(&instance->fields, &OBJ_KEY(attr), &value)) {
@@ -624,8 +1030,9 @@ static InterpretResult run(bool REPLmode) {
 				break;
 			}
 			
-			case OP_GET_BASE: {
-				ObjString* name = READ_STRING();
+			case OP_GET_BASE:
+			case OP_GET_BASE_LONG: {
+				ObjString* name = READ_STRING(OP_GET_BASE_LONG);
 				ObjClass* baseClass = AS_CLASS(pop(1));
 				if (!bindMethod(baseClass, name)) {
 					return INTERPRET_RUNTIME_ERROR;
@@ -634,6 +1041,7 @@ static InterpretResult run(bool REPLmode) {
 			}
 			
 			case OP_EQUAL: {
+				flattenOperands();
 				b = pop(1);
 				aPtr = vm.stackTop - 1;
 				*aPtr = BOOL_VAL(valuesEqual(*aPtr, b));
@@ -641,6 +1049,7 @@ static InterpretResult run(bool REPLmode) {
 			}
 			
 			case OP_SWITCH_EQUAL: {
+				flattenOperands();
 				aPtr = vm.stackTop - 1;
 				if (switchFallThrough) {
 					*aPtr = BOOL_VAL(true);
@@ -652,6 +1061,7 @@ static InterpretResult run(bool REPLmode) {
 			}
 			
 			case OP_NOT_EQUAL: {
+				flattenOperands();
 				b = pop(1);
 				aPtr = vm.stackTop - 1;
 				*aPtr = BOOL_VAL(valuesNotEqual(*aPtr, b));
@@ -660,6 +1070,7 @@ static InterpretResult run(bool REPLmode) {
 			}
 			
 			case OP_GREATER: {
+				flattenOperands();
 				b = pop(1);
 				aPtr = vm.stackTop - 1;
 				*aPtr = BOOL_VAL(valuesGreater(*aPtr, b));
@@ -667,6 +1078,7 @@ static InterpretResult run(bool REPLmode) {
 			}
 			
 			case OP_GREATER_EQUAL: {
+				flattenOperands();
 				b = pop(1);
 				aPtr = vm.stackTop - 1;
 				*aPtr = BOOL_VAL(valuesGreaterEqual(*aPtr, b));
@@ -674,6 +1086,7 @@ static InterpretResult run(bool REPLmode) {
 			}
 			
 			case OP_LESS: {
+				flattenOperands();
 				b = pop(1);
 				aPtr = vm.stackTop - 1;
 				*aPtr = BOOL_VAL(valuesLess(*aPtr, b));
@@ -681,6 +1094,7 @@ static InterpretResult run(bool REPLmode) {
 			}
 			
 			case OP_LESS_EQUAL: {
+				flattenOperands();
 				b = pop(1);
 				aPtr = vm.stackTop - 1;
 				*aPtr = BOOL_VAL(valuesLessEqual(*aPtr, b));
@@ -699,9 +1113,7 @@ static InterpretResult run(bool REPLmode) {
 				if(IS_STRING(peek(0)) && IS_STRING(peek(1))) {
 					concatenate();
 				} else if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {
-					double b = AS_NUMBER(pop(1));
-					Value* stackTop = vm.stackTop - 1; 
-		AS_NUMBER(*stackTop) = AS_NUMBER(*stackTop)+ b;
+					INTEGER_OP(+, __builtin_add_overflow);
 				} else if (IS_STRING(peek(0)) || IS_STRING(peek(1)) || IS_NL(peek(0)) || IS_NL(peek(0))) {
 					if (!convconcatenate()) {
 						return INTERPRET_RUNTIME_ERROR;
@@ -712,13 +1124,45 @@ static InterpretResult run(bool REPLmode) {
 				}
 				break;
 			}
-			case OP_SUBTRACT: BINARY_OP(NUMBER_VAL, -); break;
 			
-			case OP_MULTIPLY: BINARY_OP(NUMBER_VAL, *); break;
+			case OP_BUILD_STRING: {
+				if (!buildString(READ_BYTE())) {
+					return INTERPRET_RUNTIME_ERROR;
+				}
+				break;
+			}
+			
+			case OP_BUILD_LIST:
+				buildList(READ_BYTE());
+				break;
+			
+			case OP_BUILD_MAP: {
+				if (!buildMap(READ_BYTE())) {
+					return INTERPRET_RUNTIME_ERROR;
+				}
+				break;
+			}
+
+			case OP_SUBTRACT: INTEGER_OP(-, __builtin_sub_overflow); break;
+			
+			case OP_MULTIPLY: INTEGER_OP(*, __builtin_mul_overflow); break;
 			
 			case OP_DIVIDE: BINARY_OP(NUMBER_VAL, /); break;
 			
-			case OP_MOD: MOD_OP(NUMBER_VAL, %); break;
+			case OP_MOD: {
+				if (!truncatedDivision(true)) {
+					return INTERPRET_RUNTIME_ERROR;
+				}
+				break;
+			}
+			
+			case OP_INT_DIVIDE: {
+				if (!truncatedDivision(false)) {
+					return INTERPRET_RUNTIME_ERROR;
+				}
+				break;
+			}
+			
 			case OP_PERCENT: {
 				if(!percentOf()) {
 					return INTERPRET_RUNTIME_ERROR;
@@ -740,11 +1184,18 @@ static InterpretResult run(bool REPLmode) {
 				// Check here for errors
 				Value* valueToNegate = vm.stackTop - 1;
 				
-				(AS_NUMBER(*valueToNegate)) = 0 - (AS_NUMBER(*valueToNegate)); break;
+				if (IS_INT(*valueToNegate) && AS_INT(*valueToNegate) != INT64_MIN) {
+					AS_INT(*valueToNegate) = -AS_INT(*valueToNegate);
+				} else {
+					*valueToNegate = NUMBER_VAL(-AS_NUMBER(*valueToNegate));
+				}
+				break;
 			}
 			
 			case OP_PRINT: {
-				printValue(pop(1));
+				// the value stays on the stack, and so reachable, until it's printed.
+				printValue(peek(0));
+				pop(1);
 				if (REPLmode) printf("\n");
 				break;
 			}
@@ -756,7 +1207,7 @@ static InterpretResult run(bool REPLmode) {
 			}
 			
 			case OP_JUMP_IF_FALSE: {
-				uint8_t offset = READ_SHORT();
+				uint16_t offset = READ_SHORT();
 				if(isFalsey(peek(0))) frame->ip += offset;
 				break;
 			}
@@ -764,6 +1215,72 @@ static InterpretResult run(bool REPLmode) {
 			case OP_LOOP: {
 				uint16_t offset = READ_SHORT();
 				frame->ip -= offset;
+#ifdef GC_COMPACT
+				// Loop back-edges are a safe point: no object pointers are held in C locals here.
+				if (vm.compactPending) compactHeap();
+#endif
+				break;
+			}
+			
+			case OP_ITER_NEXT: {
+				uint8_t slot = READ_BYTE();
+				uint16_t offset = READ_SHORT();
+				// the last iteration's loop variable, and any local a 'continue' jumped past, are done with.
+				closeUpvalues(frame->slots + slot + 2);
+				vm.stackTop = frame->slots + slot + 3;
+				vm.stack.count = (int)(vm.stackTop - vm.stack.stack);
+				
+				switch (iterNext(frame, slot)) {
+					case ITER_ELEMENT:
+						frame->ip -= offset;
+#ifdef GC_COMPACT
+						// a back-edge, and a safe point like OP_LOOP.
+						if (vm.compactPending) compactHeap();
+#endif
+						break;
+					case ITER_DONE:
+						break;
+					case ITER_METHODS:
+						frame->ip += 3; // skip the jump out of the loop to the method protocol.
+						break;
+					case ITER_ERROR:
+						return INTERPRET_RUNTIME_ERROR;
+				}
+				break;
+			}
+			
+			case OP_FOR_PREP: {
+				uint8_t slot = READ_BYTE();
+				uint8_t argCount = READ_BYTE();
+				uint16_t offset = READ_SHORT();
+				if (!forPrep(frame, slot, argCount)) {
+					return INTERPRET_RUNTIME_ERROR;
+				}
+				Value* counter = frame->slots + slot;
+				if (!inRange(counter[0], counter[1], counter[2])) {
+					frame->ip += offset;
+				}
+				break;
+			}
+			
+			case OP_FOR_STEP: {
+				uint8_t slot = READ_BYTE();
+				uint16_t offset = READ_SHORT();
+				Value* counter = frame->slots + slot;
+				// as in OP_ITER_NEXT, the last iteration's loop variable gets closed over and the stack reset.
+				closeUpvalues(counter + 3);
+				vm.stackTop = counter + 4;
+				vm.stack.count = (int)(vm.stackTop - vm.stack.stack);
+				
+				Value value = stepValue(counter[0], counter[2]);
+				if (inRange(value, counter[1], counter[2])) {
+					counter[0] = value;
+					counter[3] = value;
+					frame->ip -= offset;
+#ifdef GC_COMPACT
+					if (vm.compactPending) compactHeap();
+#endif
+				}
 				break;
 			}
 			
@@ -782,6 +1299,21 @@ static InterpretResult run(bool REPLmode) {
 				break;
 			}
 			
+			case OP_MATH: {
+				MathFunction function = (MathFunction)READ_BYTE();
+				int argCount = READ_BYTE();
+				// as a native call, but with no callee below the arguments.
+				Value result = mathNative(function, argCount, vm.stackTop - argCount);
+				if (IS_NULL(result) && vm.frameCount == 0) {
+					return INTERPRET_RUNTIME_ERROR;
+				}
+				
+				vm.stackTop -= argCount;
+				vm.stack.count -= argCount;
+				push(result);
+				break;
+			}
+			
 			case OP_BREAK: {
 				uint16_t offset = READ_SHORT();
 				frame->ip += offset;
@@ -793,29 +1325,34 @@ static InterpretResult run(bool REPLmode) {
 				break;
 			}
 			
-			case OP_INVOKE: {
-				ObjString* method = READ_STRING();
+			case OP_INVOKE:
+			case OP_INVOKE_LONG: {
+				ObjString* method = READ_STRING(OP_INVOKE_LONG);
 				int argCount = READ_BYTE();
-				if (!invoke(method, argCount)) {
+				int selector = READ_SHORT();
+				if (!invoke(method, selector, argCount)) {
 					return INTERPRET_RUNTIME_ERROR;
 				}
 				frame = &vm.frames[vm.frameCount - 1];
 				break;
 			}
 			
-			case OP_BASE_INVOKE: {
-				ObjString* method = READ_STRING();
+			case OP_BASE_INVOKE:
+			case OP_BASE_INVOKE_LONG: {
+				ObjString* method = READ_STRING(OP_BASE_INVOKE_LONG);
 				int argCount = READ_BYTE();
+				int selector = READ_SHORT();
 				ObjClass* baseClass = AS_CLASS(pop(1));
-				if (!invokeFromClass(baseClass, method, argCount)) {
+				if (!invokeFromClass(baseClass, method, selector, argCount)) {
 					return INTERPRET_RUNTIME_ERROR;
 				}
 				frame = &vm.frames[vm.frameCount - 1];
 				break;
 			}
 			
-			case OP_CLOSURE: {
-				ObjFunction* function = AS_FUNCTION(READ_CONSTANT());
+			case OP_CLOSURE:
+			case OP_CLOSURE_LONG: {
+				ObjFunction* function = AS_FUNCTION(READ_OPERAND(OP_CLOSURE_LONG));
 				ObjClosure* closure = newClosure(function);
 				push(OBJ_VAL(closure));
 				
@@ -858,8 +1395,9 @@ static InterpretResult run(bool REPLmode) {
 				break;
 			}
 			
-			case OP_CLASS: {
-				push(OBJ_VAL(newClass(READ_STRING())));
+			case OP_CLASS:
+			case OP_CLASS_LONG: {
+				push(OBJ_VAL(newClass(READ_STRING(OP_CLASS_LONG))));
 				break;
 			}
 			
@@ -875,8 +1413,14 @@ static InterpretResult run(bool REPLmode) {
 				break;
 			}
 			
-			case OP_METHOD: {
-				defineMethod(READ_STRING());
+			case OP_METHOD:
+			case OP_METHOD_LONG: {
+				defineMethod(READ_STRING(OP_METHOD_LONG));
+				break;
+			}
+			
+			case OP_END_CLASS: {
+				buildVTable(AS_CLASS(peek(0)));
 				break;
 			}
 		}
@@ -885,17 +1429,18 @@ static InterpretResult run(bool REPLmode) {
 #undef READ_CONSTANT
 #undef READ_LONG_CONSTANT
 #undef READ_SHORT
+#undef READ_OPERAND
 #undef READ_STRING
 #undef BINARY_OP
+#undef INTEGER_OP
 }
 
-InterpretResult interpret(const char* source, size_t len, bool REPLmode, bool* withinREPL) {
+static InterpretResult interpretSource(const char* source, size_t len, bool REPLmode, bool* withinREPL) {
 	if (!REPLmode) {
 		// Not REPL mode
 		strlen(source);
 		ObjFunction* function = compile(source, len, REPLmode, *withinREPL);
 		if (function == NULL) {
-			clearLineInfo();
 			return INTERPRET_COMPILE_ERROR;
 		}
 	
@@ -906,14 +1451,12 @@ InterpretResult interpret(const char* source, size_t len, bool REPLmode, bool* w
 		callValue(OBJ_VAL(closure), 0);
 	
 		InterpretResult result = run(REPLmode);
-		clearLineInfo();
 		return result;
 	} else {
 		// REPL mode
 		ObjFunction* function = compileREPL(source, len, REPLmode, *withinREPL);
 		if (function == NULL) {
 			*withinREPL = true;
-			clearLineInfo();
 			return INTERPRET_COMPILE_ERROR;
 		}
 	
@@ -924,8 +1467,27 @@ InterpretResult interpret(const char* source, size_t len, bool REPLmode, bool* w
 		callValue(OBJ_VAL(closure), 0);
 	
 		InterpretResult result = run(REPLmode);
-		clearLineInfo();
 		*withinREPL = true;
+#ifdef GC_COMPACT
+		// Between two REPL lines nothing but the roots refers to the heap.
+		if (vm.compactPending) compactHeap();
+#endif
 		return result;
 	}
 }
+
+InterpretResult interpret(const char* source, size_t len, bool REPLmode, bool* withinREPL) {
+	jmp_buf handler;
+	if (setjmp(handler) != 0) {
+		// Unwound by outOfMemory(). runtimeError() has already reset the stack.
+		vm.errorHandler = NULL;
+		resetCompiler();
+		if (REPLmode) *withinREPL = true;
+		return INTERPRET_RUNTIME_ERROR;
+	}
+	
+	vm.errorHandler = &handler;
+	InterpretResult result = interpretSource(source, len, REPLmode, withinREPL);
+	vm.errorHandler = NULL;
+	return result;
+}
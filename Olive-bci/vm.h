@@ -1,6 +1,8 @@
 #ifndef olive_vm_h
 #define olive_vm_h
 
+#include <setjmp.h>
+
 #include "chunk.h"
 #include "stack.h"
 #include "object.h"
@@ -8,8 +10,16 @@
 
 #define FRAMES_MAX 64
 
-#define STACK_MAX 256
-#define NATIVE_ID_MAX 10
+#define STACK_MAX (FRAMES_MAX * (UINT8_MAX + 1)) // room for every frame to use all its local slots
+#define NATIVE_ID_MAX 64
+#define SELECTOR_MAX (UINT16_MAX + 1) // selectors are 16 bit instruction operands
+
+typedef struct {
+	int collections;
+	double pauseTime; // seconds spent in collectGarbage() and in finishing sweeps
+	size_t bytesFreed;
+	size_t peakHeap;
+} GCStats;
 
 typedef struct {
 	ObjClosure* closure;
@@ -28,18 +38,37 @@ typedef struct {
 	Table globals;
 	Table strings;
 	ObjString* initString;
+	ObjString* charStrings[UINT8_MAX + 1]; // one byte strings made by for-in over strings, filled as met
 	Table globalConstantIndex; // probably find a better name
+	Table nativeConstantIndex; // native name -> its constant, for natives the script uses without declaring a global of that name
+	Table selectors; // method name -> selector, assigned by the compiler
+	int selectorCount;
 	int nativeIdentifierCount;
 	const char* nativeIdentifiers[NATIVE_ID_MAX];
 	ObjUpvalue* openUpvalues;
 	Obj* objects;
+	uint64_t hashSeed; // picked per run, so table layouts can't be predicted
 	
 	size_t bytesAllocated;
 	size_t nextGC;
+	double heapGrowFactor;
+	size_t minCollectInterval; // minimum number of bytes allocated between two collections
+	size_t maxHeap; // hard limit on bytesAllocated, 0 for no limit
+	bool logGC;
+	GCStats gcStats;
+	Obj* sweepPrevious; // last survivor visited by the pending lazy sweep, NULL when there is none
+	size_t bytesSwept;
+	size_t bytesFreedSinceCompact;
+	bool compactPending;
+	
+	jmp_buf* errorHandler; // where outOfMemory() unwinds to, set while interpret() runs
 	
 	int grayCount;
 	int grayCapacity;
 	Obj** grayStack;
+	int viewCount; // views met while marking, settled once marking is done
+	int viewCapacity;
+	ObjString** viewStack;
 } VM;
 
 
@@ -52,8 +81,11 @@ typedef enum {
 extern VM vm;
 
 void initVM();
+void runtimeError(const char* format, ...);
+void outOfMemory();
 void freeVM(bool REPLmode);
 InterpretResult interpret(const char* source, size_t len, bool REPLmode, bool* withinREPL);
+int methodSelector(ObjString* name);
 void push(Value value);
 Value pop(uint8_t popCount);
 